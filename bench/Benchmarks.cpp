@@ -0,0 +1,343 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Benchmarks.cpp
+//
+//      Times the image code's fast paths against the code they replaced.
+//  Run with the names of the benchmarks to run, or none for all of them:
+//
+//          load    tga_load against the old per-byte decoder, for 15, 16,
+//                  24 and 32 bit, paletted and RLE files
+//          filter  the tiled 5x5 filters and the row pair Double_Size
+//                  against the old per-pixel ones, on wide panoramas
+//          gray    the integer To_Grayscale against the old double one, on
+//                  random color and on already gray input
+//
+//  Each time is the best of a few runs, in milliseconds.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "TargaImage.h"
+#include "LegacyImage.h"
+
+// after the standard headers -- libtarga.h #defines 'byte'
+#include "libtarga.h"
+#include "LegacyTarga.h"
+
+using namespace std;
+
+// constants
+const int       c_nRuns                 = 3;                            // runs timed, the best one counts
+const int       c_nLoadSize             = 2048;                         // width and height of the load benchmark's files
+const int       c_nGraySize             = 1024;                         // width and height of the gray benchmark's images
+const int       c_nGrayRuns             = 20;                           // runs timed for the gray benchmark, which is quick
+
+
+// The best of nRuns wall clock times for fn(), in milliseconds, each run
+// after an untimed setup().
+template <class S, class F>
+static double BestOf(S setup, F fn, int nRuns = c_nRuns)
+{
+    double dBest = 0;
+    for (int i = 0; i < nRuns; ++i)
+    {
+        setup();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fn();
+        double dTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (i == 0 || dTime < dBest)
+            dBest = dTime;
+    }// for
+
+    return dBest;
+}// BestOf
+
+
+// The best of c_nRuns wall clock times for fn(), in milliseconds.
+template <class F>
+static double BestOf(F fn)
+{
+    return BestOf([]() {}, fn);
+}// BestOf
+
+
+// The next of a repeatable run of pseudo-random bytes.
+static unsigned char NextByte(unsigned int& nState)
+{
+    nState = nState * 1103515245u + 12345u;
+    return (unsigned char)(nState >> 16);
+}// NextByte
+
+
+// Writes an uncompressed, top-down targa of the given type and depth with
+// pseudo-random pixels.  A paletted file gets a 256 entry, 24 bit colormap.
+static bool WriteTarga(const char* sFile, int nType, int nDepth, int nAlphaBits, int nWidth, int nHeight)
+{
+    bool            bPaletted = nType == 1;
+    unsigned char   aHeader[18] = { 0 };
+    unsigned int    nState = 1;
+
+    aHeader[1] = bPaletted ? 1 : 0;
+    aHeader[2] = (unsigned char)nType;
+    if (bPaletted)
+    {
+        aHeader[6] = 1;                 // 256 entries
+        aHeader[7] = 24;
+    }// if
+    aHeader[12] = (unsigned char)(nWidth & 0xFF);
+    aHeader[13] = (unsigned char)(nWidth >> 8);
+    aHeader[14] = (unsigned char)(nHeight & 0xFF);
+    aHeader[15] = (unsigned char)(nHeight >> 8);
+    aHeader[16] = (unsigned char)nDepth;
+    aHeader[17] = (unsigned char)(0x20 | nAlphaBits);
+
+    vector<unsigned char> aData(18 + (bPaletted ? 256 * 3 : 0) + (size_t)nWidth * nHeight * ((nDepth + 7) / 8));
+    memcpy(&aData[0], aHeader, 18);
+    for (size_t i = 18; i < aData.size(); ++i)
+        aData[i] = NextByte(nState);
+
+    FILE* pFile = fopen(sFile, "wb");
+    if (!pFile)
+        return false;
+
+    bool bResult = fwrite(&aData[0], aData.size(), 1, pFile) == 1;
+    return fclose(pFile) == 0 && bResult;
+}// WriteTarga
+
+
+// Writes a 32 bit RLE targa through libtarga, of bands of flat color and noise
+// so it has both run and raw packets.
+static bool WriteRleTarga(const char* sFile, int nWidth, int nHeight)
+{
+    vector<unsigned char>   aPixels((size_t)nWidth * nHeight * 4);
+    unsigned int            nState = 1;
+
+    for (int y = 0; y < nHeight; ++y)
+        for (int x = 0; x < nWidth; ++x)
+        {
+            unsigned char* p = &aPixels[((size_t)y * nWidth + x) * 4];
+            bool bFlat = (x / 64) % 2 == 0;
+            p[3] = 255;
+            p[0] = bFlat ? (unsigned char)y : NextByte(nState);
+            p[1] = bFlat ? (unsigned char)(x / 64) : NextByte(nState);
+            p[2] = bFlat ? 128 : NextByte(nState);
+        }// for
+
+    return tga_write_rle(sFile, nWidth, nHeight, &aPixels[0], TGA_TRUECOLOR_32) != 0;
+}// WriteRleTarga
+
+
+// Times tga_load against legacy_tga_load on one file, for both output
+// formats, and checks the two give the same pixels.
+static bool BenchLoadFile(const char* sName, const char* sFile)
+{
+    static const unsigned int   c_anFormats[] = { TGA_TRUECOLOR_32, TGA_TRUECOLOR_24 };
+    bool                        bResult = true;
+
+    for (int f = 0; f < 2; ++f)
+    {
+        unsigned int    nFormat = c_anFormats[f];
+        int             nWidth, nHeight, nOldWidth, nOldHeight;
+        void*           pNew = NULL;
+        void*           pOld = NULL;
+
+        double dOld = BestOf([&]() { free(pOld); pOld = legacy_tga_load(sFile, &nOldWidth, &nOldHeight, nFormat); });
+        double dNew = BestOf([&]() { free(pNew); pNew = tga_load(sFile, &nWidth, &nHeight, nFormat); });
+
+        bool bSame = pOld && pNew && nWidth == nOldWidth && nHeight == nOldHeight
+                     && memcmp(pOld, pNew, (size_t)nWidth * nHeight * nFormat) == 0;
+        printf("load  %-12s to %d bit  per-byte %8.1f ms  bulk %8.1f ms  %5.1fx%s\n", sName, nFormat * 8,
+               dOld, dNew, dOld / dNew, bSame ? "" : "  MISMATCH");
+
+        bResult = bResult && bSame;
+        free(pOld);
+        free(pNew);
+    }// for
+
+    return bResult;
+}// BenchLoadFile
+
+
+// The load benchmark, on c_nLoadSize square files of every depth.
+static bool BenchLoad()
+{
+    struct SFile
+    {
+        const char* sName;
+        int         nType, nDepth, nAlphaBits;
+    };
+    static const SFile c_aFiles[] = { { "15 bit",   2, 16, 1 },
+                                      { "16 bit",   2, 16, 0 },
+                                      { "24 bit",   2, 24, 0 },
+                                      { "32 bit",   2, 32, 8 },
+                                      { "paletted", 1, 8,  0 } };
+    const char*  sFile = "bench_load.tga";
+    bool         bResult = true;
+
+    for (size_t i = 0; i < sizeof(c_aFiles) / sizeof(c_aFiles[0]); ++i)
+    {
+        const SFile& file = c_aFiles[i];
+        if (!WriteTarga(sFile, file.nType, file.nDepth, file.nAlphaBits, c_nLoadSize, c_nLoadSize))
+        {
+            cout << "Unable to write " << sFile << endl;
+            return false;
+        }// if
+        bResult = BenchLoadFile(file.sName, sFile) && bResult;
+    }// for
+
+    if (!WriteRleTarga(sFile, c_nLoadSize, c_nLoadSize))
+    {
+        cout << "Unable to write " << sFile << endl;
+        return false;
+    }// if
+    bResult = BenchLoadFile("32 bit rle", sFile) && bResult;
+
+    remove(sFile);
+    return bResult;
+}// BenchLoad
+
+
+// Times one TargaImage operation against the LegacyImage one it replaced, on
+// copies of the same pixels, and checks the two give the same image.
+static bool BenchFilterOp(const char* sName, bool (TargaImage::*New)(), bool (LegacyImage::*Old)(),
+                          const vector<unsigned char>& aPixels, int nWidth, int nHeight)
+{
+    TargaImage*     pNew = NULL;
+    LegacyImage*    pOld = NULL;
+
+    double dOld = BestOf([&]() { delete pOld; pOld = new LegacyImage(nWidth, nHeight, &aPixels[0]); },
+                         [&]() { (pOld->*Old)(); });
+    double dNew = BestOf([&]() { delete pNew; pNew = new TargaImage(nWidth, nHeight, (unsigned char*)&aPixels[0]); },
+                         [&]() { (pNew->*New)(); });
+
+    bool bSame = pNew->width == pOld->width && pNew->height == pOld->height
+                 && memcmp(pNew->data, pOld->data, (size_t)pNew->width * pNew->height * 4) == 0;
+    printf("filter  %-9s %5d x %-5d  old %8.1f ms  new %8.1f ms  %5.1fx%s\n", sName, nWidth, nHeight,
+           dOld, dNew, dOld / dNew, bSame ? "" : "  MISMATCH");
+
+    delete pOld;
+    delete pNew;
+    return bSame;
+}// BenchFilterOp
+
+
+// The filter benchmark, on panoramas wide enough that the old row-major passes
+// lose the rows above and below from cache between one pixel and the next.
+static bool BenchFilter()
+{
+    struct SOp
+    {
+        const char* sName;
+        bool        (TargaImage::*New)();
+        bool        (LegacyImage::*Old)();
+    };
+    static const SOp c_aOps[] = { { "box",      &TargaImage::Filter_Box,      &LegacyImage::Filter_Box },
+                                  { "bartlett", &TargaImage::Filter_Bartlett, &LegacyImage::Filter_Bartlett },
+                                  { "gaussian", &TargaImage::Filter_Gaussian, &LegacyImage::Filter_Gaussian },
+                                  { "double",   &TargaImage::Double_Size,     &LegacyImage::Double_Size } };
+    static const int c_aSizes[][2] = { { 16384, 1024 }, { 32768, 512 } };
+    bool             bResult = true;
+
+    for (size_t s = 0; s < sizeof(c_aSizes) / sizeof(c_aSizes[0]); ++s)
+    {
+        int                     nWidth = c_aSizes[s][0], nHeight = c_aSizes[s][1];
+        vector<unsigned char>   aPixels((size_t)nWidth * nHeight * 4);
+        unsigned int            nState = 1;
+
+        for (size_t i = 0; i < aPixels.size(); ++i)
+            aPixels[i] = i % 4 == 3 ? 255 : NextByte(nState);
+
+        for (size_t i = 0; i < sizeof(c_aOps) / sizeof(c_aOps[0]); ++i)
+            bResult = BenchFilterOp(c_aOps[i].sName, c_aOps[i].New, c_aOps[i].Old, aPixels, nWidth, nHeight) && bResult;
+    }// for
+
+    return bResult;
+}// BenchFilter
+
+
+// Times To_Grayscale against the old double version on copies of the same
+// c_nGraySize square pixels, and checks the two give the same image.
+static bool BenchGrayInput(const char* sName, const vector<unsigned char>& aPixels)
+{
+    TargaImage*     pNew = NULL;
+    LegacyImage*    pOld = NULL;
+
+    double dOld = BestOf([&]() { delete pOld; pOld = new LegacyImage(c_nGraySize, c_nGraySize, &aPixels[0]); },
+                         [&]() { pOld->To_Grayscale(); }, c_nGrayRuns);
+    double dNew = BestOf([&]() { delete pNew; pNew = new TargaImage(c_nGraySize, c_nGraySize, (unsigned char*)&aPixels[0]); },
+                         [&]() { pNew->To_Grayscale(); }, c_nGrayRuns);
+
+    bool bSame = memcmp(pNew->data, pOld->data, aPixels.size()) == 0;
+    printf("gray  %-13s  double %6.2f ms  integer %6.2f ms  %5.1fx%s\n", sName,
+           dOld, dNew, dOld / dNew, bSame ? "" : "  MISMATCH");
+
+    delete pOld;
+    delete pNew;
+    return bSame;
+}// BenchGrayInput
+
+
+// The gray benchmark.  Input that is already gray is the integer code's worst
+// case: every sum is a multiple of 1000, so every pixel is redone in double.
+static bool BenchGray()
+{
+    vector<unsigned char>   aColor((size_t)c_nGraySize * c_nGraySize * 4), aGray(aColor.size());
+    unsigned int            nState = 1;
+
+    for (size_t i = 0; i < aColor.size(); i += 4)
+    {
+        unsigned char nAlpha = NextByte(nState);
+        for (int c = 0; c < 3; ++c)
+            aColor[i + c] = (unsigned char)(NextByte(nState) * nAlpha / 255);
+        aColor[i + 3] = nAlpha;
+
+        aGray[i] = aGray[i + 1] = aGray[i + 2] = NextByte(nState);
+        aGray[i + 3] = 255;
+    }// for
+
+    bool bResult = BenchGrayInput("random color", aColor);
+    return BenchGrayInput("already gray", aGray) && bResult;
+}// BenchGray
+
+
+int main(int argc, char** argv)
+{
+    struct SBenchmark
+    {
+        const char* sName;
+        bool        (*Run)();
+    };
+    static const SBenchmark c_aBenchmarks[] = { { "load",   BenchLoad },
+                                                { "filter", BenchFilter },
+                                                { "gray",   BenchGray } };
+    const int               c_nBenchmarks = sizeof(c_aBenchmarks) / sizeof(c_aBenchmarks[0]);
+    bool                    bResult = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        int b = 0;
+        while (b < c_nBenchmarks && strcmp(argv[i], c_aBenchmarks[b].sName))
+            ++b;
+        if (b == c_nBenchmarks)
+        {
+            cout << "No benchmark named " << argv[i] << endl;
+            return 1;
+        }// if
+    }// for
+
+    for (int b = 0; b < c_nBenchmarks; ++b)
+    {
+        bool bRun = argc == 1;
+        for (int i = 1; i < argc; ++i)
+            bRun = bRun || !strcmp(argv[i], c_aBenchmarks[b].sName);
+        if (bRun)
+            bResult = c_aBenchmarks[b].Run() && bResult;
+    }// for
+
+    return bResult ? 0 : 1;
+}// main
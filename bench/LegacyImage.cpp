@@ -0,0 +1,402 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      LegacyImage.cpp
+//
+//      The row-major 5x5 filters and Double_Size as TargaImage had them
+//  before they were tiled, and To_Grayscale as it was before it moved to
+//  integers, kept only so Benchmarks can time the two side by side.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "LegacyImage.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Convert image to grayscale.  Red, green, and blue channels should all 
+//  contain grayscale value.  Alpha channel shoould be left unchanged.  Return
+//  success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool LegacyImage::To_Grayscale()
+{
+	for (int i = 0; i < height; i++)
+	{
+		for (int j = 0; j < width; j++)
+		{
+			double I = 0;
+			I += data[(i * width + j) * 4] * 0.299;//R
+			I += data[(i * width + j) * 4 + 1] * 0.587;//G
+			I += data[(i * width + j) * 4 + 2] * 0.114;//B
+
+			data[(i * width + j) * 4] = I; //R
+			data[(i * width + j) * 4 + 1] = I; //G
+			data[(i * width + j) * 4 + 2] = I; //B
+		}
+	}
+	return true;
+}// To_Grayscale
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Perform 5x5 box filter on this image.  Return success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool LegacyImage::Filter_Box()
+{
+	unsigned char* newImage = new unsigned char[width * height * 4];
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int sum_red = 0, sum_green = 0, sum_blue = 0;
+
+			for (int j = -2; j <= 2; j++)
+			{
+				for (int i = -2; i <= 2; i++)
+				{
+					int surround_x, surround_y;
+					if (((x + i) < 0) || ((x + i) >= width))
+					{
+						surround_x = x - i;
+					}
+					else
+					{
+						surround_x = x + i;
+					}
+
+					if (((y + j) < 0) || ((y + j) >= height))
+					{
+						surround_y = y - j;
+					}
+					else
+					{
+						surround_y = y + j;
+					}
+
+					sum_red += data[(surround_y * width + surround_x) * 4];
+					sum_green += data[(surround_y * width + surround_x) * 4 + 1];
+					sum_blue += data[(surround_y * width + surround_x) * 4 + 2];
+				}
+			}
+			newImage[(y * width + x) * 4] = sum_red / 25;
+			newImage[(y * width + x) * 4 + 1] = sum_green / 25;
+			newImage[(y * width + x) * 4 + 2] = sum_blue / 25;
+			newImage[(y * width + x) * 4 + 3] = 255;
+		}
+	}
+
+	memcpy(data, newImage, sizeof(unsigned char) * width * height * 4);
+	delete[] newImage;
+
+	return true;
+}// Filter_Box
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Perform 5x5 Bartlett filter on this image.  Return success of 
+//  operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool LegacyImage::Filter_Bartlett()
+{
+	unsigned char* newImage = new unsigned char[width * height * 4];
+	const int matrix[5][5] = {
+								{1,2,3,2,1},
+								{2,4,6,4,2},
+								{3,6,9,6,3},
+								{2,4,6,4,2},
+								{1,2,3,2,1}
+	};
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int sum_red = 0, sum_green = 0, sum_blue = 0;
+
+			for (int j = -2; j <= 2; j++)
+			{
+				for (int i = -2; i <= 2; i++)
+				{
+					int surround_x, surround_y;
+					if (((x + i) < 0) || ((x + i) >= width))
+					{
+						surround_x = x - i;
+					}
+					else
+					{
+						surround_x = x + i;
+					}
+
+					if (((y + j) < 0) || ((y + j) >= height))
+					{
+						surround_y = y - j;
+					}
+					else
+					{
+						surround_y = y + j;
+					}
+
+					sum_red += data[(surround_y * width + surround_x) * 4] * matrix[j + 2][i + 2];
+					sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix[j + 2][i + 2];
+					sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix[j + 2][i + 2];
+				}
+			}
+			newImage[(y * width + x) * 4] = sum_red / 81;
+			newImage[(y * width + x) * 4 + 1] = sum_green / 81;
+			newImage[(y * width + x) * 4 + 2] = sum_blue / 81;
+			newImage[(y * width + x) * 4 + 3] = 255;
+		}
+	}
+
+	memcpy(data, newImage, sizeof(unsigned char) * width * height * 4);
+	delete[] newImage;
+
+	return true;
+}// Filter_Bartlett
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Perform 5x5 Gaussian filter on this image.  Return success of 
+//  operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool LegacyImage::Filter_Gaussian()
+{
+	unsigned char* newImage = new unsigned char[width * height * 4];
+	const int matrix[5][5] = {
+								{1,4,6,4,1},
+								{4,16,24,16,4},
+								{6,24,36,24,6},
+								{4,16,24,16,4},
+								{1,4,6,4,1}
+	};
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int sum_red = 0, sum_green = 0, sum_blue = 0;
+
+			for (int j = -2; j <= 2; j++)
+			{
+				for (int i = -2; i <= 2; i++)
+				{
+					int surround_x, surround_y;
+					if (((x + i) < 0) || ((x + i) >= width))
+					{
+						surround_x = x - i;
+					}
+					else
+					{
+						surround_x = x + i;
+					}
+
+					if (((y + j) < 0) || ((y + j) >= height))
+					{
+						surround_y = y - j;
+					}
+					else
+					{
+						surround_y = y + j;
+					}
+
+					sum_red += data[(surround_y * width + surround_x) * 4] * matrix[j + 2][i + 2];
+					sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix[j + 2][i + 2];
+					sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix[j + 2][i + 2];
+				}
+			}
+			newImage[(y * width + x) * 4] = sum_red / 256;
+			newImage[(y * width + x) * 4 + 1] = sum_green / 256;
+			newImage[(y * width + x) * 4 + 2] = sum_blue / 256;
+			newImage[(y * width + x) * 4 + 3] = 255;
+		}
+	}
+
+	memcpy(data, newImage, sizeof(unsigned char) * width * height * 4);
+	delete[] newImage;
+
+	return true;
+}// Filter_Gaussian
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Double the dimensions of this image.  Return success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool LegacyImage::Double_Size()
+{
+	unsigned char* newImage = new unsigned char[(width * 2) * (height * 2) * 4];
+	float matrix_even[3][3] = {
+							{0.0625,0.125,0.0625},
+							{0.125,0.25,0.125},
+							{0.0625,0.125,0.0625}
+	};
+
+	float matrix_odd[4][4] = {
+							{0.015625,0.046875,0.046875,0.015625},
+							{0.046875,0.140625,0.140625,0.046875},
+							{0.046875,0.140625,0.140625,0.046875},
+							{0.015625,0.046875,0.046875,0.015625}
+	};
+
+	float matrix_even_odd[4][3] = {
+							{0.03125,0.0625,0.03125},
+							{0.09375,0.18755,0.09375},
+							{0.09375,0.18755,0.09375},
+							{0.03125,0.0625,0.03125}
+	};
+
+	for (int y = 0; y < height * 2; y++)
+	{
+		for (int x = 0; x < width * 2; x++)
+		{
+			float sum_red = 0, sum_green = 0, sum_blue = 0;
+			if ((x % 2 == 0) && (y % 2 == 0))
+			{
+				for (int j = -1; j <= 1; j++)
+				{
+					for (int i = -1; i <= 1; i++)
+					{
+						int surround_x, surround_y;
+						if (((x / 2 + i) < 0) || ((x / 2 + i) >= width))
+						{
+							surround_x = (x / 2) - i;
+						}
+						else
+						{
+							surround_x = (x / 2) + i;
+						}
+
+						if (((y / 2 + j) < 0) || ((y / 2 + j) >= height))
+						{
+							surround_y = y / 2 - j;
+						}
+						else
+						{
+							surround_y = y / 2 + j;
+						}
+
+						sum_red += data[(surround_y * width + surround_x) * 4] * matrix_even[i + 1][j + 1];
+						sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix_even[i + 1][j + 1];
+						sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix_even[i + 1][j + 1];
+					}
+				}
+			}
+			else if ((x % 2 == 1) && (y % 2 == 1))
+			{
+				for (int j = -1; j <= 2; j++)
+				{
+					for (int i = -1; i <= 2; i++)
+					{
+						int surround_x, surround_y;
+						if (((x / 2 + i) < 0) || ((x / 2 + i) >= width))
+						{
+							surround_x = (x / 2) - i;
+						}
+						else
+						{
+							surround_x = (x / 2) + i;
+						}
+
+						if (((y / 2 + j) < 0) || ((y / 2 + j) >= height))
+						{
+							surround_y = y / 2 - j;
+						}
+						else
+						{
+							surround_y = y / 2 + j;
+						}
+
+						sum_red += data[(surround_y * width + surround_x) * 4] * matrix_odd[i + 1][j + 1];
+						sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix_odd[i + 1][j + 1];
+						sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix_odd[i + 1][j + 1];
+					}
+				}
+			}
+			else if ((x % 2 == 0) && (y % 2 == 1))
+			{
+				for (int j = -1; j <= 2; j++)
+				{
+					for (int i = -1; i <= 1; i++)
+					{
+						int surround_x, surround_y;
+						if (((x / 2 + i) < 0) || ((x / 2 + i) >= width))
+						{
+							surround_x = (x / 2) - i;
+						}
+						else
+						{
+							surround_x = (x / 2) + i;
+						}
+
+						if (((y / 2 + j) < 0) || ((y / 2 + j) >= height))
+						{
+							surround_y = y / 2 - j;
+						}
+						else
+						{
+							surround_y = y / 2 + j;
+						}
+
+						sum_red += data[(surround_y * width + surround_x) * 4] * matrix_even_odd[j + 1][i + 1];
+						sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix_even_odd[j + 1][i + 1];
+						sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix_even_odd[j + 1][i + 1];
+					}
+				}
+			}
+
+			else if ((x % 2 == 1) && (y % 2 == 0))
+			{
+				for (int j = -1; j <= 1; j++)
+				{
+					for (int i = -1; i <= 2; i++)
+					{
+						int surround_x, surround_y;
+						if (((x / 2 + i) < 0) || ((x / 2 + i) >= width))
+						{
+							surround_x = (x / 2) - i;
+						}
+						else
+						{
+							surround_x = (x / 2) + i;
+						}
+
+						if (((y / 2 + j) < 0) || ((y / 2 + j) >= height))
+						{
+							surround_y = y / 2 - j;
+						}
+						else
+						{
+							surround_y = y / 2 + j;
+						}
+
+						sum_red += data[(surround_y * width + surround_x) * 4] * matrix_even_odd[i + 1][j + 1];
+						sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix_even_odd[i + 1][j + 1];
+						sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix_even_odd[i + 1][j + 1];
+					}
+				}
+			}
+
+
+
+			newImage[(y * (width * 2) + x) * 4] = sum_red;
+			newImage[(y * (width * 2) + x) * 4 + 1] = sum_green;
+			newImage[(y * (width * 2) + x) * 4 + 2] = sum_blue;
+			newImage[(y * (width * 2) + x) * 4 + 3] = 255;
+		}
+	}
+
+	width *= 2;
+	height *= 2;
+
+	delete[] data;
+	data = newImage;
+
+	return true;
+}// Double_Size
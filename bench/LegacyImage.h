@@ -0,0 +1,45 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      LegacyImage.h
+//
+//      Just enough of the old TargaImage to run the code the tiled filters,
+//  Double_Size and integer To_Grayscale replaced, for Benchmarks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LEGACY_IMAGE_H_
+#define _LEGACY_IMAGE_H_
+
+#include <string.h>
+
+class LegacyImage
+{
+    // methods
+    public:
+        // a copy of the w by h RGBA pixels d
+        LegacyImage(int w, int h, const unsigned char* d)
+            : width(w), height(h), data(new unsigned char[w * h * 4])
+        {
+            memcpy(data, d, w * h * 4);
+        }
+
+        ~LegacyImage() { delete[] data; }
+
+        bool To_Grayscale();
+        bool Filter_Box();
+        bool Filter_Bartlett();
+        bool Filter_Gaussian();
+        bool Double_Size();
+
+    private:
+        LegacyImage(const LegacyImage&);
+        LegacyImage& operator=(const LegacyImage&);
+
+    // members
+    public:
+        int             width;
+        int             height;
+        unsigned char*  data;       // RGBA, allocated with new[]
+};// LegacyImage
+
+#endif // _LEGACY_IMAGE_H_
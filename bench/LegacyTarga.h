@@ -0,0 +1,19 @@
+#ifndef _legacy_targa_h_
+#define _legacy_targa_h_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* tga_load as it was before the bulk decoder: every pixel is read with its own fread
+   calls and converted one at a time.  Same arguments and results as tga_load. */
+void * legacy_tga_load( const char * file, int * width, int * height, unsigned int format );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* _legacy_targa_h_ */
@@ -35,7 +35,7 @@ const int   c_minWindowHeight       = 100;
 //      Constructor.  Add the buttons to the window.
 //
 ///////////////////////////////////////////////////////////////////////////////
-ImageWidget::ImageWidget(int x, int y, int w, int h, const char *title) : Fl_Widget(x, y, Max(w, c_minWindowWidth), Max(h, c_minWindowHeight), title), m_pImage(NULL)
+ImageWidget::ImageWidget(int x, int y, int w, int h, const char *title) : Fl_Widget(x, y, Max(w, c_minWindowWidth), Max(h, c_minWindowHeight), title), m_pImage(NULL), m_pRGB(NULL), m_nRGBWidth(0), m_nRGBHeight(0)
 {
     // add controls-
     int horizontalCenter = Max(w, c_minWindowWidth) / 2;
@@ -60,6 +60,7 @@ ImageWidget::ImageWidget(int x, int y, int w, int h, const char *title) : Fl_Wid
 ImageWidget::~ImageWidget()
 {
     delete m_pImage;
+    delete[] m_pRGB;
 }// ~ImageWidget
 
 
@@ -84,14 +85,38 @@ void ImageWidget::draw()
     if (!m_pImage)          // Don't do anything if the image is empty.
     	return;
     
-    unsigned char   *rgb;
-    rgb = m_pImage->To_RGB(); // Convert the pre-multiplied RGBA image into RGB.
-    unsigned int imageX = x() + (w() > m_pImage->width) ? (w() - m_pImage->width) / 2 : 0;
-    fl_draw_image(rgb, imageX, y() + c_border * 2 + c_buttonHeight, m_pImage->width, m_pImage->height, 3);
-    delete[] rgb;
+    // Convert the pre-multiplied RGBA image into RGB, but only once per change --
+    // exposes, moves and resizes redraw from the same conversion.
+    if (!m_pRGB)
+    {
+        m_pRGB = m_pImage->To_RGB();
+        m_rgbStamp = m_pImage->Stamp();
+        m_nRGBWidth = m_pImage->width;
+        m_nRGBHeight = m_pImage->height;
+    }// if
+
+    // only the part inside the clip, which after a command is just what it changed
+    int nImageX, nImageY, nClipX, nClipY, nClipW, nClipH;
+    Image_Origin(nImageX, nImageY);
+    fl_clip_box(nImageX, nImageY, m_pImage->width, m_pImage->height, nClipX, nClipY, nClipW, nClipH);
+    if (nClipW > 0 && nClipH > 0)
+        fl_draw_image(m_pRGB + ((nClipY - nImageY) * m_pImage->width + nClipX - nImageX) * 3,
+                      nClipX, nClipY, nClipW, nClipH, 3, m_pImage->width * 3);
 }// draw
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Find where the image's top left corner goes in the window.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ImageWidget::Image_Origin(int& nX, int& nY)
+{
+    nX = x() + (w() > m_pImage->width ? (w() - m_pImage->width) / 2 : 0);
+    nY = y() + c_border * 2 + c_buttonHeight;
+}// Image_Origin
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Redraw the window.
@@ -117,7 +142,53 @@ void ImageWidget::CommandCallback(Fl_Widget* pWidget, void* pData)
 {
     ImageWidget* pImageWidget = static_cast<ImageWidget*>(pData);
     CScriptHandler::HandleCommand(static_cast<Fl_Input*>(pWidget)->value(), pImageWidget->m_pImage);
-    pImageWidget->Redraw();
+    if (!pImageWidget->Refresh_RGB())
+    {
+        pImageWidget->Invalidate_RGB();
+        pImageWidget->Redraw();
+    }// if
 }// CommandCallback
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Bring the display conversion up to date with just the rectangles the
+//  image has changed since it was made, and repaint only those.  Returns
+//  false, doing nothing, if the image was replaced or resized, which needs
+//  the whole window redone.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ImageWidget::Refresh_RGB()
+{
+    if (!m_pRGB || !m_pImage || m_pImage->width != m_nRGBWidth || m_pImage->height != m_nRGBHeight)
+        return false;
+
+    ImageRect aRects[c_changeLog];
+    int nRects = m_pImage->Changes_Since(m_rgbStamp, aRects, c_changeLog);
+    int nImageX, nImageY;
+
+    Image_Origin(nImageX, nImageY);
+    for (int i = 0; i < nRects; ++i)
+    {
+        m_pImage->To_RGB(m_pRGB, aRects[i]);
+        damage(FL_DAMAGE_USER1, nImageX + aRects[i].x, nImageY + aRects[i].y, aRects[i].width, aRects[i].height);
+    }// for
+
+    m_rgbStamp = m_pImage->Stamp();
+    return true;
+}// Refresh_RGB
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Drop the display conversion of the image, which a command may have
+//  changed or replaced.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ImageWidget::Invalidate_RGB()
+{
+    delete[] m_pRGB;
+    m_pRGB = NULL;
+}// Invalidate_RGB
+
+
@@ -14,10 +14,10 @@
 
 #include <Fl/Fl.h>
 #include <Fl/Fl_Widget.h>
+#include "TargaImage.h"
 
 class Fl_Box;
 class Fl_Input;
-class TargaImage;
 
 class ImageWidget : public Fl_Widget
 {
@@ -33,11 +33,17 @@ class ImageWidget : public Fl_Widget
 
     private:
         static void CommandCallback(Fl_Widget* pWidget, void* pData);           // command entered callback
+        void Invalidate_RGB();                                                  // the image was replaced or resized, so convert it again on the next draw
+        bool Refresh_RGB();                                                     // convert and repaint just what changed, false if that won't do
+        void Image_Origin(int& nX, int& nY);                                    // where the image's top left corner is drawn
 
 
     // members
     private:
         TargaImage* m_pImage;	                // The image to display (current image).
+        unsigned char* m_pRGB;                  // m_pImage converted for display, NULL until the next draw after a change
+        ImageStamp  m_rgbStamp;                 // m_pImage's changes as of that conversion
+        int         m_nRGBWidth, m_nRGBHeight;  // and its size
         Fl_Box*     m_pStaticTextBox;           // static text
         Fl_Input*   m_pCommandInput;            // input box
 };
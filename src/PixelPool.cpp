@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      PixelPool.cpp
+//
+//      Implementation of PixelPool methods.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "PixelPool.h"
+#include <stdlib.h>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+// constants
+const size_t    c_alignment         = 64;                   // every block starts on a cache line
+const size_t    c_minClassBytes     = 4096;                 // smallest size class
+const int       c_classesPerDoubling = 8;                   // so a block is at most 1/8 bigger than asked for
+const int       c_numClasses        = 1 + 64 * c_classesPerDoubling;
+
+namespace
+{
+    // sits just in front of every block handed out
+    struct SBlockHeader
+    {
+        void*   pRaw;           // what malloc returned
+        size_t  nBytes;         // size of the block's class
+        int     nClass;
+        int     nRefs;          // holders of the block, guarded by the pool's lock
+    };// SBlockHeader
+
+    struct SPoolState
+    {
+        mutex                   lock;
+        vector<SBlockHeader*>   aFree[c_numClasses];    // released blocks, by size class
+        size_t                  nCacheLimit;
+        SPoolStats              stats;
+
+        SPoolState() : nCacheLimit(512 << 20)
+        {
+            stats.nRequests = stats.nHits = 0;
+            stats.nBytesInUse = stats.nPeakBytes = stats.nBytesCached = 0;
+        }
+    };// SPoolState
+
+    // never destroyed, so images freed during static destruction still have a pool to go to
+    SPoolState& State()
+    {
+        static SPoolState* pState = new SPoolState;
+        return *pState;
+    }// State
+}// namespace
+
+
+// Finds the size class for a request, and the size of that class's blocks.
+static int Size_Class(size_t bytes, size_t& classBytes)
+{
+    if (bytes <= c_minClassBytes)
+    {
+        classBytes = c_minClassBytes;
+        return 0;
+    }// if
+
+    // bytes is in (base, 2 * base], which is split into equal steps
+    size_t base = c_minClassBytes;
+    int octave = 0;
+    while (base * 2 < bytes)
+    {
+        base *= 2;
+        ++octave;
+    }// while
+
+    size_t step = base / c_classesPerDoubling;
+    size_t k = (bytes - base + step - 1) / step;
+
+    classBytes = base + k * step;
+    return 1 + octave * c_classesPerDoubling + (int)(k - 1);
+}// Size_Class
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Hand out a 64 byte aligned block of at least the given size, reusing a
+//  released one of the same size class if there is one.  Throws bad_alloc
+//  like new if the system is out of memory.
+//
+///////////////////////////////////////////////////////////////////////////////
+unsigned char* PixelPool::Allocate(size_t bytes)
+{
+    SPoolState& state = State();
+    SBlockHeader* pHeader = NULL;
+    size_t classBytes;
+    int nClass = Size_Class(bytes, classBytes);
+
+    {
+        lock_guard<mutex> guard(state.lock);
+
+        ++state.stats.nRequests;
+        if (!state.aFree[nClass].empty())
+        {
+            pHeader = state.aFree[nClass].back();
+            state.aFree[nClass].pop_back();
+            ++state.stats.nHits;
+            state.stats.nBytesCached -= classBytes;
+        }// if
+
+        state.stats.nBytesInUse += classBytes;
+        if (state.stats.nBytesInUse > state.stats.nPeakBytes)
+            state.stats.nPeakBytes = state.stats.nBytesInUse;
+    }
+
+    if (!pHeader)
+    {
+        void* pRaw = malloc(classBytes + sizeof(SBlockHeader) + c_alignment);
+        if (!pRaw)
+        {
+            lock_guard<mutex> guard(state.lock);
+            state.stats.nBytesInUse -= classBytes;
+            throw bad_alloc();
+        }// if
+
+        size_t block = ((size_t)pRaw + sizeof(SBlockHeader) + c_alignment - 1) & ~(c_alignment - 1);
+        pHeader = (SBlockHeader*)block - 1;
+        pHeader->pRaw = pRaw;
+        pHeader->nBytes = classBytes;
+        pHeader->nClass = nClass;
+    }// if
+
+    pHeader->nRefs = 1;
+    return (unsigned char*)(pHeader + 1);
+}// Allocate
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Drop a hold on a block from Allocate.  Once the last holder lets go it
+//  is kept for reuse, unless that would put the cache over its limit.
+//
+///////////////////////////////////////////////////////////////////////////////
+void PixelPool::Release(unsigned char* block)
+{
+    if (!block)
+        return;
+
+    SPoolState& state = State();
+    SBlockHeader* pHeader = (SBlockHeader*)block - 1;
+
+    {
+        lock_guard<mutex> guard(state.lock);
+
+        if (--pHeader->nRefs > 0)
+            return;
+
+        state.stats.nBytesInUse -= pHeader->nBytes;
+        if (state.stats.nBytesCached + pHeader->nBytes <= state.nCacheLimit)
+        {
+            state.aFree[pHeader->nClass].push_back(pHeader);
+            state.stats.nBytesCached += pHeader->nBytes;
+            return;
+        }// if
+    }
+
+    free(pHeader->pRaw);
+}// Release
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Add a holder to a block from Allocate, which then takes one more
+//  Release to give back.  Returns the block.
+//
+///////////////////////////////////////////////////////////////////////////////
+unsigned char* PixelPool::Share(unsigned char* block)
+{
+    if (block)
+    {
+        lock_guard<mutex> guard(State().lock);
+        ++((SBlockHeader*)block - 1)->nRefs;
+    }// if
+
+    return block;
+}// Share
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return whether anyone besides the caller holds the block.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool PixelPool::Is_Shared(const unsigned char* block)
+{
+    if (!block)
+        return false;
+
+    lock_guard<mutex> guard(State().lock);
+    return ((const SBlockHeader*)block - 1)->nRefs > 1;
+}// Is_Shared
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Set the most bytes released blocks may hold on to.  If more than that
+//  is already cached, the cache is emptied.
+//
+///////////////////////////////////////////////////////////////////////////////
+void PixelPool::Set_Cache_Limit(size_t bytes)
+{
+    {
+        lock_guard<mutex> guard(State().lock);
+        State().nCacheLimit = bytes;
+        if (State().stats.nBytesCached <= bytes)
+            return;
+    }
+
+    Trim();
+}// Set_Cache_Limit
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Free every cached block.
+//
+///////////////////////////////////////////////////////////////////////////////
+void PixelPool::Trim()
+{
+    SPoolState& state = State();
+    vector<SBlockHeader*> aFreed;
+
+    {
+        lock_guard<mutex> guard(state.lock);
+        for (int i = 0; i < c_numClasses; ++i)
+        {
+            aFreed.insert(aFreed.end(), state.aFree[i].begin(), state.aFree[i].end());
+            state.aFree[i].clear();
+        }// for
+        state.stats.nBytesCached = 0;
+    }
+
+    for (size_t i = 0; i < aFreed.size(); ++i)
+        free(aFreed[i]->pRaw);
+}// Trim
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return a snapshot of the pool's counters.
+//
+///////////////////////////////////////////////////////////////////////////////
+SPoolStats PixelPool::Get_Stats()
+{
+    lock_guard<mutex> guard(State().lock);
+    return State().stats;
+}// Get_Stats
@@ -0,0 +1,44 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      PixelPool.h
+//
+//      Allocator for image-sized pixel buffers.  Blocks are 64 byte aligned
+//  and rounded up to a size class; released blocks are kept for reuse by
+//  the next request of the same class, so a script that keeps making and
+//  dropping 100MB images doesn't go back to the system (and take fresh page
+//  faults) every time.  A block can have several holders, so images can
+//  share pixels until one of them needs to change them.  Safe to use from
+//  any thread.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PIXEL_POOL_H_
+#define _PIXEL_POOL_H_
+
+#include <stddef.h>
+
+struct SPoolStats
+{
+    size_t  nRequests;          // calls to Allocate
+    size_t  nHits;              // of those, how many reused a cached block
+    size_t  nBytesInUse;        // bytes in blocks handed out and not yet released
+    size_t  nPeakBytes;         // the most nBytesInUse has ever been
+    size_t  nBytesCached;       // bytes in released blocks kept for reuse
+};// SPoolStats
+
+class PixelPool
+{
+    // methods
+    public:
+        static unsigned char* Allocate(size_t bytes);  // a 64 byte aligned block of at least bytes, never NULL
+        static void Release(unsigned char* block);      // give back a block from Allocate or Share, NULL is ignored
+        static unsigned char* Share(unsigned char* block);  // another hold on the block, which needs its own Release
+        static bool Is_Shared(const unsigned char* block);  // whether the block has more than one holder
+
+        static void Set_Cache_Limit(size_t bytes);      // most bytes to keep in released blocks, 512MB to start
+        static void Trim();                             // free every cached block
+
+        static SPoolStats Get_Stats();
+};// PixelPool
+
+#endif // _PIXEL_POOL_H_
@@ -0,0 +1,216 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      PointLUT.cpp
+//
+//      Implementation of PointLUT methods.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "PointLUT.h"
+#include <math.h>
+
+
+// Rounds v to the nearest level, clamped to 0 to 255.
+static unsigned char To_Level(double v)
+{
+    return v <= 0 ? 0 : (v >= 255 ? 255 : (unsigned char)floor(v + 0.5));
+}// To_Level
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Make a table that leaves every pixel as it is.
+//
+///////////////////////////////////////////////////////////////////////////////
+PointLUT::PointLUT()
+    : gray(false)
+{
+    for (int c = 0; c < 3; ++c)
+        for (int v = 0; v < 256; ++v)
+            pre[c][v] = post[c][v] = (unsigned char)v;
+}// PointLUT
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      The table for To_Grayscale.
+//
+///////////////////////////////////////////////////////////////////////////////
+PointLUT PointLUT::Gray()
+{
+    PointLUT lut;
+    lut.gray = true;
+    return lut;
+}// Gray
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      The table for Quant_Uniform, which keeps the top three bits of red and
+//  green and the top two of blue.
+//
+///////////////////////////////////////////////////////////////////////////////
+PointLUT PointLUT::Quant_Uniform()
+{
+    PointLUT lut;
+    for (int v = 0; v < 256; ++v)
+    {
+        lut.pre[0][v] = (unsigned char)(v & 0xE0);
+        lut.pre[1][v] = (unsigned char)(v & 0xE0);
+        lut.pre[2][v] = (unsigned char)(v & 0xC0);
+    }// for
+
+    return lut;
+}// Quant_Uniform
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      The table for Dither_Threshold: gray, then black for levels up to 127
+//  and white above.
+//
+///////////////////////////////////////////////////////////////////////////////
+PointLUT PointLUT::Threshold()
+{
+    PointLUT lut = Gray();
+    for (int c = 0; c < 3; ++c)
+        for (int v = 0; v < 256; ++v)
+            lut.post[c][v] = v > 127 ? 255 : 0;
+
+    return lut;
+}// Threshold
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      A levels adjustment: black and below go to 0, white and above to 255,
+//  and the levels between are stretched over the whole range and then
+//  raised to 1 / gamma.  Expects black below white and gamma above 0.
+//
+///////////////////////////////////////////////////////////////////////////////
+PointLUT PointLUT::Levels(int black, int white, float gamma)
+{
+    PointLUT lut;
+    for (int v = 0; v < 256; ++v)
+    {
+        double t = v <= black ? 0 : (v >= white ? 1 : (double)(v - black) / (white - black));
+        lut.pre[0][v] = lut.pre[1][v] = lut.pre[2][v] = To_Level(255 * pow(t, 1.0 / gamma));
+    }// for
+
+    return lut;
+}// Levels
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      A gamma adjustment, 255 * (v / 255) ^ (1 / gamma).  Expects gamma
+//  above 0.
+//
+///////////////////////////////////////////////////////////////////////////////
+PointLUT PointLUT::Gamma(float gamma)
+{
+    return Levels(0, 255, gamma);
+}// Gamma
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      A tone curve of straight lines through numPoints x, y pairs, given
+//  one after the other with x increasing.  Levels before the first x or after
+//  the last take its y.  Expects at least one point.
+//
+///////////////////////////////////////////////////////////////////////////////
+PointLUT PointLUT::Curve(const int* points, int numPoints)
+{
+    PointLUT lut;
+    int i = 0;
+    for (int v = 0; v < 256; ++v)
+    {
+        while (i < numPoints - 1 && v > points[i * 2 + 2])
+            ++i;
+
+        const int* p = points + i * 2;
+        double y = p[1];
+        if (i < numPoints - 1 && v > p[0])
+            y += (double)(p[3] - p[1]) * (v - p[0]) / (p[2] - p[0]);
+        lut.pre[0][v] = lut.pre[1][v] = lut.pre[2][v] = To_Level(y);
+    }// for
+
+    return lut;
+}// Curve
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return the table that does this one and then next.  The pre tables of
+//  both run one after the other unless there's a gray level between them;
+//  then what follows it, being the same for every channel, folds into the
+//  post tables.
+//
+///////////////////////////////////////////////////////////////////////////////
+PointLUT PointLUT::Then(const PointLUT& next) const
+{
+    PointLUT lut(*this);
+
+    if (!gray)
+    {
+        for (int c = 0; c < 3; ++c)
+            for (int v = 0; v < 256; ++v)
+            {
+                lut.pre[c][v] = next.pre[c][pre[c][v]];
+                lut.post[c][v] = next.post[c][v];
+            }// for
+        lut.gray = next.gray;
+    }// if
+    else
+    {
+        // every channel starts from the same level v after this one's gray
+        for (int v = 0; v < 256; ++v)
+        {
+            int r = next.pre[0][post[0][v]];
+            int g = next.pre[1][post[1][v]];
+            int b = next.pre[2][post[2][v]];
+            int level = next.gray ? Gray_Level(r, g, b) : 0;
+
+            lut.post[0][v] = next.gray ? next.post[0][level] : (unsigned char)r;
+            lut.post[1][v] = next.gray ? next.post[1][level] : (unsigned char)g;
+            lut.post[2][v] = next.gray ? next.post[2][level] : (unsigned char)b;
+        }// for
+    }// else
+
+    return lut;
+}// Then
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Run the table over the view's pixels, rows in parallel.
+//
+///////////////////////////////////////////////////////////////////////////////
+void PointLUT::Apply(const ImageView& view) const
+{
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < view.height; ++i)
+    {
+        unsigned char* p = view.Row(i);
+        if (!gray)
+        {
+            for (int x = 0; x < view.width; ++x, p += 4)
+            {
+                p[0] = pre[0][p[0]];
+                p[1] = pre[1][p[1]];
+                p[2] = pre[2][p[2]];
+            }// for
+        }// if
+        else
+        {
+            for (int x = 0; x < view.width; ++x, p += 4)
+            {
+                int level = Gray_Level(pre[0][p[0]], pre[1][p[1]], pre[2][p[2]]);
+                p[0] = post[0][level];
+                p[1] = post[1][level];
+                p[2] = post[2][level];
+            }// for
+        }// else
+    }// for
+}// Apply
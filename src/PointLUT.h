@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      PointLUT.h
+//
+//      Point operations as lookup tables.  A PointLUT sends each pixel's
+//  red, green and blue through a table apiece, can then take the gray level
+//  of the result and send that through a second table for each channel.
+//  That covers uniform quantization, gray, threshold dithering and tone
+//  curves, and a run of any of them composes into one PointLUT, so the
+//  whole run costs a single pass over the pixels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _POINT_LUT_H_
+#define _POINT_LUT_H_
+
+#include "TargaImage.h"
+
+// To_Grayscale's gray level, (299r + 587g + 114b) / 1000 in integers.  The
+// weights have always been 0.299, 0.587 and 0.114 in double, though, and when
+// the sum is a multiple of 1000 their rounding sometimes lands just under it,
+// a level lower.  Those sums are redone in double to keep the same levels.
+inline int Gray_Level(int r, int g, int b)
+{
+    int n = r * 299 + g * 587 + b * 114;
+    int level = n / 1000;
+
+    if (level * 1000 == n)
+    {
+        double I = 0;
+        I += r * 0.299;
+        I += g * 0.587;
+        I += b * 0.114;
+        level = (int)I;
+    }// if
+
+    return level;
+}// Gray_Level
+
+class PointLUT
+{
+    // methods
+    public:
+        PointLUT();                                 // leaves every pixel as it is
+
+        static PointLUT Gray();                     // To_Grayscale
+        static PointLUT Quant_Uniform();            // Quant_Uniform's 3-3-2 bit masks
+        static PointLUT Threshold();                // Dither_Threshold, gray and then black up to 127, white above
+        static PointLUT Levels(int black, int white, float gamma = 1.0f);  // black to white stretched over 0 to 255, then Gamma
+        static PointLUT Gamma(float gamma);         // 255 * (v / 255) ^ (1 / gamma), so above 1 brightens
+        static PointLUT Curve(const int* points, int numPoints);   // straight lines through x, y pairs in x order, level past the ends
+
+        PointLUT Then(const PointLUT& next) const;  // this and then next, as one
+
+        // Change the view's red, green and blue in place, leaving alpha be.  Like
+        // the operations it stands for it works on the stored bytes, so on the
+        // pre-multiplied values of translucent pixels.
+        void Apply(const ImageView& view) const;
+
+    // members
+    private:
+        unsigned char   pre[3][256];    // red, green and blue tables, first
+        bool            gray;           // whether the gray level of those is then taken
+        unsigned char   post[3][256];   // and with gray, each channel's table from it
+};// PointLUT
+
+#endif // _POINT_LUT_H_
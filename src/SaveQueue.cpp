@@ -0,0 +1,353 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      SaveQueue.cpp
+//
+//      Implementation of CSaveQueue methods.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// windows.h goes first -- libtarga.h #defines 'byte'.
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "SaveQueue.h"
+#include "TargaImage.h"
+#include <stdlib.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return the queue, creating it the first time through.
+//
+///////////////////////////////////////////////////////////////////////////////
+CSaveQueue& CSaveQueue::Instance()
+{
+    static CSaveQueue queue;
+    return queue;
+}// Instance
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Constructor.  The writer thread isn't started until the first save.
+//
+///////////////////////////////////////////////////////////////////////////////
+CSaveQueue::CSaveQueue() : m_bQuit(false), m_bFailed(false)
+{}// CSaveQueue
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Destructor.  Let the writer finish whatever is queued, then stop it.
+//
+///////////////////////////////////////////////////////////////////////////////
+CSaveQueue::~CSaveQueue()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_bQuit = true;
+    }
+    m_changed.notify_all();
+
+    if (m_writer.joinable())
+        m_writer.join();
+}// ~CSaveQueue
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Snapshot the image and queue it to be written to the given file.  If
+//  the last save queued to the file was of this image at this size, only the
+//  rows it has changed since are rewritten, unless the file's size or time
+//  shows something else has written it by then.  Return success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool CSaveQueue::Save(const TargaImage& image, const char* sFilename)
+{
+    if (!sFilename || (!image.data && !image.Is_Planar()))
+        return false;
+
+    // take the snapshot before waiting, while the caller still holds the image
+    // steady.  It shares the image's pixels, which only get copied if the
+    // caller changes them before the save is done.
+    SJob job;
+    job.pImage = new TargaImage(image);
+    job.sFilename = sFilename;
+    job.sPath = Canonical(sFilename);
+    job.nTop = 0;
+    job.nRows = -1;
+
+    unique_lock<mutex> lock(m_mutex);
+
+    map<string, SSaved>::iterator it = m_saved.find(job.sPath);
+    if (it != m_saved.end() && it->second.nWidth == image.width && it->second.nHeight == image.height)
+    {
+        ImageRect aRects[c_changeLog];
+        int nRects = image.Changes_Since(it->second.stamp, aRects, c_changeLog);
+        int nTop = image.height, nBottom = 0;
+
+        for (int i = 0; i < nRects; ++i)
+        {
+            nTop = min(nTop, aRects[i].y);
+            nBottom = max(nBottom, aRects[i].y + aRects[i].height);
+        }// for
+
+        if (nTop >= nBottom)
+            job.nRows = 0;
+        else if (nBottom - nTop < image.height)
+        {
+            job.nTop = nTop;
+            job.nRows = nBottom - nTop;
+        }// else if
+    }// if
+
+    // a file new to m_saved has had nothing written by us yet for Run to check against
+    SSaved& saved = m_saved[job.sPath];
+    if (it == m_saved.end())
+        saved.bWritten = false;
+    saved.stamp = image.Stamp();
+    saved.nWidth = image.width;
+    saved.nHeight = image.height;
+
+    if (!m_writer.joinable())
+        m_writer = thread(&CSaveQueue::Run, this);
+
+    while (m_jobs.size() >= c_maxPending)
+        m_changed.wait(lock);
+
+    m_jobs.push_back(job);
+    lock.unlock();
+    m_changed.notify_all();
+
+    return true;
+}// Save
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Wait for every queued save to finish.  Return false if any failed since
+//  the last sync.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool CSaveQueue::Sync()
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    while (!m_jobs.empty())
+        m_changed.wait(lock);
+
+    bool bResult = !m_bFailed;
+    m_bFailed = false;
+    return bResult;
+}// Sync
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Wait until no save to the given file is still pending, under whatever
+//  name it was saved.
+//
+///////////////////////////////////////////////////////////////////////////////
+void CSaveQueue::Wait_For(const char* sFilename)
+{
+    if (!sFilename)
+        return;
+
+    unique_lock<mutex> lock(m_mutex);
+    if (m_jobs.empty())
+        return;
+
+    string sPath = Canonical(sFilename);
+    for (;;)
+    {
+        bool bPending = false;
+        for (deque<SJob>::const_iterator it = m_jobs.begin(); it != m_jobs.end() && !bPending; ++it)
+            bPending = it->sPath == sPath;
+
+        if (!bPending)
+            break;
+        m_changed.wait(lock);
+    }// for
+}// Wait_For
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Forget what was last saved to the given file, for when something else
+//  has written over it.
+//
+///////////////////////////////////////////////////////////////////////////////
+void CSaveQueue::Forget(const char* sFilename)
+{
+    if (!sFilename)
+        return;
+
+    string sPath = Canonical(sFilename);
+
+    lock_guard<mutex> lock(m_mutex);
+    m_saved.erase(sPath);
+}// Forget
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return whether the two names refer to the same file: the same canonical
+//  path, or elsewhere than Windows, the same device and inode, which also
+//  catches links.  Names that don't exist yet only match by path.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool CSaveQueue::Same_File(const char* sFilename1, const char* sFilename2)
+{
+    if (Canonical(sFilename1) == Canonical(sFilename2))
+        return true;
+
+#ifndef _WIN32
+    struct stat info1, info2;
+    if (!stat(sFilename1, &info1) && !stat(sFilename2, &info2))
+        return info1.st_dev == info2.st_dev && info1.st_ino == info2.st_ino;
+#endif
+
+    return false;
+}// Same_File
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return the absolute path of the given file with its directory resolved,
+//  so "out.tga", "./out.tga" and "../here/out.tga" all come out the same.  On
+//  Windows that's _fullpath, lower-cased since names there ignore case;
+//  elsewhere realpath of the directory plus the file's own name, which works
+//  before the file exists.  A directory that can't be resolved leaves the name
+//  as it was given.
+//
+///////////////////////////////////////////////////////////////////////////////
+string CSaveQueue::Canonical(const char* sFilename)
+{
+    string sName = sFilename;
+
+#ifdef _WIN32
+    char sFull[_MAX_PATH];
+    if (!_fullpath(sFull, sFilename, _MAX_PATH))
+        return sName;
+
+    sName = sFull;
+    for (size_t i = 0; i < sName.size(); ++i)
+        sName[i] = (char)tolower((unsigned char)sName[i]);
+    return sName;
+#else
+    size_t nSlash = sName.rfind('/');
+    string sDir = nSlash == string::npos ? "." : (nSlash == 0 ? "/" : sName.substr(0, nSlash));
+    string sLeaf = nSlash == string::npos ? sName : sName.substr(nSlash + 1);
+
+    char* sReal = realpath(sDir.c_str(), NULL);
+    if (!sReal)
+        return sName;
+
+    string sPath = sReal;
+    free(sReal);
+    if (sPath.empty() || sPath[sPath.size() - 1] != '/')
+        sPath += '/';
+    return sPath + sLeaf;
+#endif
+}// Canonical
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Get the size of the given file and when it was last modified, to the
+//  nanosecond where the platform keeps that (100ns on Windows; _stat only
+//  gives whole seconds there).  Return false if the file can't be read.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool CSaveQueue::Stat(const char* sFilename, long long& nSize, long long& nTime)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(sFilename, GetFileExInfoStandard, &info))
+        return false;
+
+    nTime = ((long long)info.ftLastWriteTime.dwHighDateTime << 32 | info.ftLastWriteTime.dwLowDateTime) * 100;
+    nSize = (long long)info.nFileSizeHigh << 32 | info.nFileSizeLow;
+#else
+    struct stat info;
+    if (stat(sFilename, &info))
+        return false;
+
+#ifdef __APPLE__
+    nTime = (long long)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    nTime = (long long)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    nSize = (long long)info.st_size;
+#endif
+
+    return true;
+}// Stat
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Write out queued snapshots in order until told to quit with nothing
+//  left to do.
+//
+///////////////////////////////////////////////////////////////////////////////
+void CSaveQueue::Run()
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        while (m_jobs.empty() && !m_bQuit)
+            m_changed.wait(lock);
+
+        if (m_jobs.empty())
+            break;
+
+        // the job stays queued while it's written, so Sync and Wait_For see it.
+        // Every earlier save to its file is done, so m_saved says what the
+        // last one left there.
+        SJob job = m_jobs.front();
+        map<string, SSaved>::iterator it = m_saved.find(job.sPath);
+        bool bWritten = it != m_saved.end() && it->second.bWritten;
+        long long nSize = bWritten ? it->second.nFileSize : 0;
+        long long nTime = bWritten ? it->second.nFileTime : 0;
+        lock.unlock();
+
+        // a file that isn't what we last left there, or that something else
+        // has written since, gets written out whole
+        long long nNowSize, nNowTime;
+        bool bUnchanged = bWritten && Stat(job.sFilename.c_str(), nNowSize, nNowTime)
+                          && nNowSize == nSize && nNowTime == nTime;
+        bool bResult = bUnchanged && job.nRows >= 0 && job.pImage->Update_Image(job.sFilename.c_str(), job.nTop, job.nRows);
+        if (!bResult)
+            bResult = job.pImage->Save_Image(job.sFilename.c_str());
+        if (!bResult)
+            cout << "Unable to save image:  " << job.sFilename << endl;
+        delete job.pImage;
+
+        bool bStat = bResult && Stat(job.sFilename.c_str(), nSize, nTime);
+
+        lock.lock();
+        m_jobs.pop_front();
+        m_bFailed = m_bFailed || !bResult;
+        it = m_saved.find(job.sPath);
+        if (!bStat)
+            m_saved.erase(job.sPath);
+        else if (it != m_saved.end())
+        {
+            it->second.bWritten = true;
+            it->second.nFileSize = nSize;
+            it->second.nFileTime = nTime;
+        }// else if
+        m_changed.notify_all();
+    }// for
+}// Run
@@ -0,0 +1,106 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      SaveQueue.h
+//
+//      Writes images out on a background thread so scripts can carry on
+//  while a save is in progress.  Each save works from its own snapshot of
+//  the image, so later commands are free to change the original.  Saving
+//  an image again to the file it was last saved to rewrites just the rows
+//  that changed since, as long as the file's size and modified time are
+//  still what that save left.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _C_SAVE_QUEUE
+#define _C_SAVE_QUEUE
+
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "TargaImage.h"
+
+class CSaveQueue
+{
+    // methods
+    public:
+        static CSaveQueue& Instance();              // the one queue every save goes through
+
+        ~CSaveQueue();                              // finishes any pending saves
+
+        ///////////////////////////////////////////////////////////////////////////////
+        //
+        //      Snapshot the image and queue it to be written to the given file.  Only
+        //  blocks when two saves are already pending, which bounds the memory held
+        //  by snapshots.  Returns false if the snapshot could not be queued.
+        //
+        ///////////////////////////////////////////////////////////////////////////////
+        bool Save(const TargaImage& image, const char* sFilename);
+
+        ///////////////////////////////////////////////////////////////////////////////
+        //
+        //      Wait for every queued save to reach disk.  Returns false if any save
+        //  has failed since the last sync.
+        //
+        ///////////////////////////////////////////////////////////////////////////////
+        bool Sync();
+
+        // Wait for any queued saves to the given file, so it can be read back.
+        void Wait_For(const char* sFilename);
+
+        // Something else wrote the file, so the next save to it must write all of it.
+        void Forget(const char* sFilename);
+
+        // Whether the two names are the same file, however each path is spelled.
+        static bool Same_File(const char* sFilename1, const char* sFilename2);
+
+    private:
+        CSaveQueue();
+        CSaveQueue(const CSaveQueue&);
+        CSaveQueue& operator=(const CSaveQueue&);
+
+        void Run();                                 // the writer thread
+
+        // The file a name refers to, the same however the path to it is spelled,
+        // as far as the directory goes.  Pending saves and m_saved go by this.
+        static std::string Canonical(const char* sFilename);
+
+        // The file's size and last modified time, or false if it can't be read.
+        static bool Stat(const char* sFilename, long long& nSize, long long& nTime);
+
+        struct SJob
+        {
+            TargaImage*     pImage;                 // snapshot to write, owned by the queue
+            std::string     sFilename;
+            std::string     sPath;                  // Canonical(sFilename)
+            int             nTop;                   // first row to rewrite in place ...
+            int             nRows;                  // ... and how many, or -1 to write the whole file
+        };// SJob
+
+        // what the last save queued to a file left in it
+        struct SSaved
+        {
+            ImageStamp      stamp;                  // of the image saved
+            int             nWidth, nHeight;
+            bool            bWritten;               // a save to the file has reached disk, leaving it ...
+            long long       nFileSize;              // ... this size ...
+            long long       nFileTime;              // ... and modified at this time, as Stat gives it
+        };// SSaved
+
+    // members
+    private:
+        static const size_t     c_maxPending = 2;   // the save being written plus one waiting
+
+        std::deque<SJob>        m_jobs;             // pending saves, the one being written at the front
+        std::map<std::string, SSaved>   m_saved;    // by canonical path, dropped when a save to the file fails
+        std::mutex              m_mutex;
+        std::condition_variable m_changed;          // signalled whenever m_jobs changes or we quit
+        std::thread             m_writer;
+        bool                    m_bQuit;
+        bool                    m_bFailed;          // a save failed since the last sync
+};// CSaveQueue
+
+#endif // _C_SAVE_QUEUE
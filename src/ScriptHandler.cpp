@@ -13,13 +13,24 @@
 #include "ScriptHandler.h"
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <string.h>
+#include <vector>
+#include <algorithm>
 #include "TargaImage.h"
+#include "SaveQueue.h"
+#include "PixelPool.h"
+#include "PointLUT.h"
 
 using namespace std;
 
 // constants
 const int       c_maxLineLength         = 1000;                         // maximum length of a command in a script
+const int       c_maxCurvePoints        = 64;                           // most points a "curve" can go through
+const int       c_maxPatternSize        = 256;                          // widest and tallest tile "dither-pattern" takes
 const char      c_sWhiteSpace[]         = " \t\n\r"; 
 const char      c_asCommands[][32]      = { "load",                     // valid commands
                                             "save",
@@ -50,7 +61,16 @@ const char      c_asCommands[][32]      = { "load",                     // valid
                                             "comp-atop",
                                             "comp-xor",
                                             "diff",
-                                            "rotate"
+                                            "rotate",
+                                            "stream",
+                                            "sync",
+                                            "pool-stats",
+                                            "roi",
+                                            "planar",
+                                            "precision",
+                                            "levels",
+                                            "gamma",
+                                            "curve"
                                           };
 
 enum ECommands          // command ids
@@ -85,9 +105,230 @@ enum ECommands          // command ids
     COMP_XOR,
     DIFF,
     ROTATE,
+    STREAM,
+    SYNC,
+    POOL_STATS,
+    ROI,
+    PLANAR,
+    PRECISION,
+    LEVELS,
+    GAMMA,
+    CURVE,
     NUM_COMMANDS
 };// ECommands
 
+// region set by "roi" that later operations are limited to -- x, y, width, height
+static bool     s_bRoi = false;
+static int      s_aRoi[4];
+
+// whether images are worked on as float planes, set by "planar" or "precision"
+static bool     s_bPlanar = false;
+
+
+// Returns whether the line is a "load" with just a filename, copying the filename out.
+static bool IsPlainLoad(const char* sLine, char* sFilename)
+{
+    char sCopy[c_maxLineLength + 1];
+    strcpy(sCopy, sLine);
+
+    char* sToken = strtok(sCopy, c_sWhiteSpace);
+    if (!sToken || strcmp(sToken, c_asCommands[LOAD]))
+        return false;
+
+    char* sName = strtok(NULL, c_sWhiteSpace);
+    if (!sName || strtok(NULL, c_sWhiteSpace))
+        return false;
+
+    strcpy(sFilename, sName);
+    return true;
+}// IsPlainLoad
+
+
+// Returns whether the line is a lone "half".
+static bool IsHalf(const char* sLine)
+{
+    char sCopy[c_maxLineLength + 1];
+    strcpy(sCopy, sLine);
+
+    char* sToken = strtok(sCopy, c_sWhiteSpace);
+    return sToken && !strcmp(sToken, c_asCommands[HALF]) && !strtok(NULL, c_sWhiteSpace);
+}// IsHalf
+
+
+// Reads the arguments of a "levels", "gamma" or "curve" command, from strtok,
+// into the table it runs.  Returns false if they don't make sense.
+static bool ParseTone(int command, PointLUT& lut)
+{
+    int  anArgs[c_maxCurvePoints * 2 + 1];
+    char* asArgs[c_maxCurvePoints * 2 + 1];
+    int  nArgs = 0;
+    for (char* sArg = strtok(NULL, c_sWhiteSpace); sArg; sArg = strtok(NULL, c_sWhiteSpace))
+    {
+        if (nArgs == c_maxCurvePoints * 2 + 1)
+            return false;
+        asArgs[nArgs] = sArg;
+        anArgs[nArgs++] = atoi(sArg);
+    }// for
+
+    switch (command)
+    {
+        case LEVELS:
+        {
+            // levels <black> <white> [gamma]
+            float gamma = nArgs == 3 ? (float)atof(asArgs[2]) : 1.0f;
+            if ((nArgs != 2 && nArgs != 3) || anArgs[0] < 0 || anArgs[0] >= anArgs[1] || anArgs[1] > 255 || !(gamma > 0))
+                return false;
+
+            lut = PointLUT::Levels(anArgs[0], anArgs[1], gamma);
+            return true;
+        }// LEVELS
+
+        case GAMMA:
+        {
+            // gamma <gamma>
+            float gamma = nArgs == 1 ? (float)atof(asArgs[0]) : 0;
+            if (!(gamma > 0))
+                return false;
+
+            lut = PointLUT::Gamma(gamma);
+            return true;
+        }// GAMMA
+
+        case CURVE:
+        {
+            // curve <x> <y> <x> <y> [...] -- x from 0 to 255 and increasing
+            if (nArgs < 4 || nArgs % 2)
+                return false;
+            for (int i = 0; i < nArgs; ++i)
+                if (anArgs[i] < 0 || anArgs[i] > 255 || (i % 2 == 0 && i > 0 && anArgs[i] <= anArgs[i - 2]))
+                    return false;
+
+            lut = PointLUT::Curve(anArgs, nArgs / 2);
+            return true;
+        }// CURVE
+    }// switch
+
+    return false;
+}// ParseTone
+
+
+// Reads a dither-rand seed: decimal, or hex after an explicit 0x.  Returns
+// false for anything else, a leading zero included, since strtoul would take
+// "010" as octal.
+static bool ParseSeed(const char* sSeed, unsigned int& nSeed)
+{
+    bool bHex = sSeed[0] == '0' && (sSeed[1] == 'x' || sSeed[1] == 'X');
+    const char* sDigits = bHex ? sSeed + 2 : sSeed;
+    if (!(bHex ? isxdigit((unsigned char)sDigits[0]) : isdigit((unsigned char)sDigits[0]))
+        || (!bHex && sDigits[0] == '0' && sDigits[1]))
+        return false;
+
+    char* sEnd;
+    errno = 0;
+    unsigned long nValue = strtoul(sDigits, &sEnd, bHex ? 16 : 10);
+    if (*sEnd || errno == ERANGE || nValue > UINT_MAX)
+        return false;
+
+    nSeed = (unsigned int)nValue;
+    return true;
+}// ParseSeed
+
+
+// Returns whether the line is a point operation that a table can stand for,
+// and with what table: a lone "gray", "quant-unif" or "dither-thresh", or a
+// "levels", "gamma" or "curve" that makes sense.
+static bool PointLUTOf(const char* sLine, PointLUT& lut)
+{
+    char sCopy[c_maxLineLength + 1];
+    strcpy(sCopy, sLine);
+
+    char* sToken = strtok(sCopy, c_sWhiteSpace);
+    if (!sToken)
+        return false;
+
+    int command;
+    for (command = 0; command < NUM_COMMANDS; ++command)
+        if (!strcmp(sToken, c_asCommands[command]))
+            break;
+
+    if (command == LEVELS || command == GAMMA || command == CURVE)
+        return ParseTone(command, lut);
+    if (strtok(NULL, c_sWhiteSpace))
+        return false;
+
+    if (command == GRAY)
+        lut = PointLUT::Gray();
+    else if (command == QUANT_UNIF)
+        lut = PointLUT::Quant_Uniform();
+    else if (command == DITHER_THRESH)
+        lut = PointLUT::Threshold();
+    else
+        return false;
+
+    return true;
+}// PointLUTOf
+
+
+// Fills aTile with the thresholds a "dither-pattern" names: bayer2, bayer4,
+// bayer8, bayer16 or cluster, or else a tile image whose gray levels are the
+// thresholds.  Returns false if there's no such pattern.
+static bool LoadPattern(char* sName, vector<unsigned char>& aTile, int& nWidth, int& nHeight)
+{
+    for (int n = 2; n <= 16; n *= 2)
+    {
+        ostringstream sBayer;
+        sBayer << "bayer" << n;
+        if (sBayer.str() == sName)
+        {
+            aTile.resize(n * n);
+            TargaImage::Bayer_Tile(n, &aTile[0]);
+            nWidth = nHeight = n;
+            return true;
+        }// if
+    }// for
+
+    if (!strcmp(sName, "cluster"))
+    {
+        aTile.resize(16);
+        TargaImage::Cluster_Tile(&aTile[0]);
+        nWidth = nHeight = 4;
+        return true;
+    }// if
+
+    TargaImage* pTile = TargaImage::Load_Image(sName);
+    if (!pTile)
+        return false;
+
+    bool bResult = pTile->width <= c_maxPatternSize && pTile->height <= c_maxPatternSize;
+    if (bResult)
+    {
+        nWidth = pTile->width;
+        nHeight = pTile->height;
+        aTile.resize(nWidth * nHeight);
+
+        ImageView view = pTile->View();
+        for (int y = 0; y < nHeight; ++y)
+            for (int x = 0; x < nWidth; ++x)
+            {
+                const unsigned char* p = view.Row(y) + x * 4;
+                aTile[y * nWidth + x] = (unsigned char)Gray_Level(p[0], p[1], p[2]);
+            }// for
+    }// if
+
+    delete pTile;
+    return bResult;
+}// LoadPattern
+
+
+// Runs an operation on the region of interest if one is set, otherwise on the whole image.
+static bool Apply(TargaImage* pImage, bool (TargaImage::*whole)(), bool (TargaImage::*region)(const ImageView&))
+{
+    if (!s_bRoi)
+        return (pImage->*whole)();
+
+    return (pImage->*region)(pImage->View(s_aRoi[0], s_aRoi[1], s_aRoi[2], s_aRoi[3]));
+}// Apply
+
 
 ///////////////////////////////////////////////////////////////////////////////
 //
@@ -112,12 +353,44 @@ bool CScriptHandler::HandleCommand(const char* sCommand, TargaImage*& pImage)
             break;
 
     // if there's no image only a subset of commands are valid
-    if (!pImage && command != LOAD && command != RUN && command != NUM_COMMANDS)
+    if (!pImage && command != LOAD && command != RUN && command != STREAM && command != SYNC && command != POOL_STATS && command != ROI && command != PLANAR && command != PRECISION && command != NUM_COMMANDS)
     {
         cout << "No image to operate on.  Use \"load\" command to load image." << endl;
         return false;
     }// if
 
+    // saves are written in the background, so a file this command names may
+    // still be on its way out -- let it land first.
+    if (command != SAVE)
+    {
+        char* sArgs = new char[strlen(sCommand) + 1];
+        strcpy(sArgs, sCommand);
+        for (char* sArg = strtok(sArgs, c_sWhiteSpace); sArg; sArg = strtok(NULL, c_sWhiteSpace))
+            CSaveQueue::Instance().Wait_For(sArg);
+        delete[] sArgs;
+
+        // the copy above used strtok too, so find our place again
+        strcpy(sCommandLine, sCommand);
+        strtok(sCommandLine, c_sWhiteSpace);
+    }// if
+
+    // the rest change the image's size or need all of it
+    if (s_bRoi && (command == FILTER_GAUSS_N || command == FILTER_EDGE || command == FILTER_ENHANCE || command == NPR_PAINT
+                   || command == HALF || command == DOUBLE || command == SCALE || command == ROTATE || command == DIFF
+                   || (command >= COMP_OVER && command <= COMP_XOR)))
+    {
+        cout << "Command works on the whole image only.  Use \"roi\" alone to clear the region." << endl;
+        delete[] sCommandLine;
+        return false;
+    }// if
+
+    // in planar mode the operations with planar versions get planes, even
+    // after some other operation has packed the image
+    if (s_bPlanar && !s_bRoi && (command == GRAY || command == DITHER_FS || command == DITHER_COLOR
+                                 || command == FILTER_BOX || command == FILTER_BARTLETT || command == FILTER_GAUSS
+                                 || command == HALF || command == DOUBLE))
+        pImage->To_Planar();
+
     // handle the command
     bool bResult,
          bParsed = true;
@@ -129,7 +402,10 @@ bool CScriptHandler::HandleCommand(const char* sCommand, TargaImage*& pImage)
             if (pImage)
                 delete pImage;
             char* sFilename = strtok(NULL, c_sWhiteSpace);
-            bResult = (pImage = TargaImage::Load_Image(sFilename)) != NULL;
+            char* sReduce = strtok(NULL, c_sWhiteSpace);
+            bResult = (pImage = TargaImage::Load_Image(sFilename, sReduce ? atoi(sReduce) : 1)) != NULL;
+            if (bResult && s_bPlanar)
+                pImage->To_Planar();
 
             if (!bResult)
             {
@@ -150,7 +426,7 @@ bool CScriptHandler::HandleCommand(const char* sCommand, TargaImage*& pImage)
                 cout << "No filename given." << endl;
 
             bParsed = sFilename != NULL;
-            bResult =  bParsed && pImage->Save_Image(sFilename);
+            bResult =  bParsed && CSaveQueue::Instance().Save(*pImage, sFilename);
             break;
         }// SAVE
 
@@ -162,73 +438,111 @@ bool CScriptHandler::HandleCommand(const char* sCommand, TargaImage*& pImage)
 
         case GRAY:
         {
-            bResult = pImage->To_Grayscale();
+            bResult = Apply(pImage, &TargaImage::To_Grayscale, &TargaImage::To_Grayscale);
             break;
         }// GREY
 
         case QUANT_UNIF:
         {
-            bResult = pImage->Quant_Uniform();
+            bResult = Apply(pImage, &TargaImage::Quant_Uniform, &TargaImage::Quant_Uniform);
             break;
         }// QUANT_UNIF
 
         case QUANT_POP:
         {
-            bResult = pImage->Quant_Populosity();
+            bResult = Apply(pImage, &TargaImage::Quant_Populosity, &TargaImage::Quant_Populosity);
             break;
         }// QUANT_POP
 
         case DITHER_THRESH:
         {
-            bResult = pImage->Dither_Threshold();
+            bResult = Apply(pImage, &TargaImage::Dither_Threshold, &TargaImage::Dither_Threshold);
             break;
         }// QUANT_THRESH
 
         case DITHER_RAND:
         {
-            bResult = pImage->Dither_Random();
+            // dither-rand [seed] -- a seed gives the same noise every time
+            char* sSeed = strtok(NULL, c_sWhiteSpace);
+            unsigned int nSeed;
+            if (!sSeed)
+                bResult = Apply(pImage, &TargaImage::Dither_Random, &TargaImage::Dither_Random);
+            else if (!ParseSeed(sSeed, nSeed))
+            {
+                cout << "Invalid seed.  Use a decimal number or 0x and a hex one." << endl;
+                bParsed = bResult = false;
+            }// else if
+            else
+            {
+                // the noise is keyed on where the pixels are, so pass the rectangle's corner once clipped
+                ImageView view = s_bRoi ? pImage->View(s_aRoi[0], s_aRoi[1], s_aRoi[2], s_aRoi[3]) : pImage->View();
+                int nLeft = s_bRoi ? max(s_aRoi[0], 0) : 0, nTop = s_bRoi ? max(s_aRoi[1], 0) : 0;
+                bResult = pImage->Dither_Random(view, nSeed, nLeft, nTop);
+            }// else
             break;
         }// DITHER_RAND
 
         case DITHER_FS:
         {
-            bResult = pImage->Dither_FS();
+            bResult = Apply(pImage, &TargaImage::Dither_FS, &TargaImage::Dither_FS);
             break;
         }// DITHER_FS
 
         case DITHER_BRIGHT:
         {
-            bResult = pImage->Dither_Bright();
+            bResult = Apply(pImage, &TargaImage::Dither_Bright, &TargaImage::Dither_Bright);
             break;
         }// DITHER_BRIGHT
         
         case DITHER_CLUSTER:
         {
-            bResult = pImage->Dither_Cluster();
+            bResult = Apply(pImage, &TargaImage::Dither_Cluster, &TargaImage::Dither_Cluster);
             break;
         }// DITHER_CLUSTER
+
+        case DITHER_PATTERN:
+        {
+            // dither-pattern [bayer2|bayer4|bayer8|bayer16|cluster|<tile.tga>] -- bayer4 by default
+            char  sDefault[] = "bayer4";
+            char* sPattern = strtok(NULL, c_sWhiteSpace);
+            vector<unsigned char> aTile;
+            int nWidth, nHeight;
+
+            bParsed = LoadPattern(sPattern ? sPattern : sDefault, aTile, nWidth, nHeight);
+            if (!bParsed)
+                cout << "Unable to load pattern:  " << sPattern << ".  Use bayer2, bayer4, bayer8, bayer16, cluster or a tile image up to "
+                     << c_maxPatternSize << " pixels a side." << endl;
+            else
+            {
+                ImageView view = s_bRoi ? pImage->View(s_aRoi[0], s_aRoi[1], s_aRoi[2], s_aRoi[3]) : pImage->View();
+                bResult = pImage->Dither_Pattern(view, &aTile[0], nWidth, nHeight);
+            }// else
+
+            bResult = bParsed && bResult;
+            break;
+        }// DITHER_PATTERN
         
         case DITHER_COLOR:
         {
-            bResult = pImage->Dither_Color();
+            bResult = Apply(pImage, &TargaImage::Dither_Color, &TargaImage::Dither_Color);
             break;
         }// DITHER_COLOR
 
         case FILTER_BOX:
         {
-            bResult = pImage->Filter_Box();
+            bResult = Apply(pImage, &TargaImage::Filter_Box, &TargaImage::Filter_Box);
             break;
         }// DITHER_BOX
 
         case FILTER_BARTLETT:
         {
-            bResult = pImage->Filter_Bartlett();
+            bResult = Apply(pImage, &TargaImage::Filter_Bartlett, &TargaImage::Filter_Bartlett);
             break;
         }// DITHER_BARTLETT
 
         case FILTER_GAUSS:
         {
-            bResult = pImage->Filter_Gaussian();
+            bResult = Apply(pImage, &TargaImage::Filter_Gaussian, &TargaImage::Filter_Gaussian);
             break;
         }// FILTER_GUASS
 
@@ -414,6 +728,161 @@ bool CScriptHandler::HandleCommand(const char* sCommand, TargaImage*& pImage)
             break;
         }// ROTATE
 
+        case STREAM:
+        {
+            // stream <in> <out> <op> [<op> ...] -- only operations that
+            // work a pixel at a time can run on bands of rows.  dither-rand
+            // takes its seed as dither-rand:<seed>.
+            char* sInFile = strtok(NULL, c_sWhiteSpace);
+            char* sOutFile = strtok(NULL, c_sWhiteSpace);
+            TargaImage::PointOp aOps[c_maxLineLength / 2];
+            unsigned int anSeeds[c_maxLineLength / 2];
+            const size_t nDitherRand = strlen(c_asCommands[DITHER_RAND]);
+            int nOps = 0;
+
+            bParsed = sInFile && sOutFile;
+            if (!bParsed)
+                cout << "No filename given." << endl;
+
+            for (char* sOp = strtok(NULL, c_sWhiteSpace); bParsed && sOp; sOp = strtok(NULL, c_sWhiteSpace))
+            {
+                if (!strcmp(sOp, c_asCommands[GRAY]))
+                    aOps[nOps++] = &TargaImage::To_Grayscale;
+                else if (!strcmp(sOp, c_asCommands[QUANT_UNIF]))
+                    aOps[nOps++] = &TargaImage::Quant_Uniform;
+                else if (!strcmp(sOp, c_asCommands[DITHER_THRESH]))
+                    aOps[nOps++] = &TargaImage::Dither_Threshold;
+                else if (!strncmp(sOp, c_asCommands[DITHER_RAND], nDitherRand) && (!sOp[nDitherRand] || sOp[nDitherRand] == ':'))
+                {
+                    // one seed for the whole file, not one for each band
+                    anSeeds[nOps] = (unsigned int)rand();
+                    if (sOp[nDitherRand] && !ParseSeed(sOp + nDitherRand + 1, anSeeds[nOps]))
+                    {
+                        cout << "Invalid seed.  Use a decimal number or 0x and a hex one." << endl;
+                        bParsed = false;
+                    }// if
+                    aOps[nOps++] = &TargaImage::Dither_Random;
+                }// else if
+                else
+                {
+                    cout << "Unable to stream command:  " << sOp << endl;
+                    bParsed = false;
+                }// else
+            }// for
+
+            if (bParsed)
+                CSaveQueue::Instance().Forget(sOutFile);
+            bResult = bParsed && TargaImage::Stream_Image(sInFile, sOutFile, aOps, anSeeds, nOps);
+            break;
+        }// STREAM
+
+        case SYNC:
+        {
+            bResult = CSaveQueue::Instance().Sync();
+            if (!bResult)
+                cout << "Not every image was saved." << endl;
+            break;
+        }// SYNC
+
+        case POOL_STATS:
+        {
+            SPoolStats stats = PixelPool::Get_Stats();
+            cout << "Pixel pool:  " << stats.nHits << " of " << stats.nRequests << " allocations reused";
+            if (stats.nRequests)
+                cout << " (" << 100 * stats.nHits / stats.nRequests << "%)";
+            cout << ", peak " << stats.nPeakBytes / 1024 << "KB in use, "
+                 << stats.nBytesInUse / 1024 << "KB in use now, "
+                 << stats.nBytesCached / 1024 << "KB cached" << endl;
+            bResult = true;
+            break;
+        }// POOL_STATS
+
+        case ROI:
+        {
+            // roi <x> <y> <w> <h> limits later operations to that rectangle, roi alone clears it
+            char* asArgs[4];
+            int nArgs = 0;
+            for (char* sArg = strtok(NULL, c_sWhiteSpace); sArg && nArgs < 5; sArg = strtok(NULL, c_sWhiteSpace))
+            {
+                if (nArgs < 4)
+                    asArgs[nArgs] = sArg;
+                ++nArgs;
+            }// for
+
+            if (nArgs == 0)
+                s_bRoi = false;
+            else if (nArgs == 4 && atoi(asArgs[2]) > 0 && atoi(asArgs[3]) > 0)
+            {
+                for (int i = 0; i < 4; ++i)
+                    s_aRoi[i] = atoi(asArgs[i]);
+                s_bRoi = true;
+            }// else if
+            else
+            {
+                cout << "Invalid region.  Use \"roi x y width height\", or \"roi\" to clear it." << endl;
+                bParsed = false;
+            }// else
+
+            bResult = bParsed;
+            break;
+        }// ROI
+
+        case PLANAR:
+        {
+            // planar [on|off] -- keep images as float planes between operations
+            char* sMode = strtok(NULL, c_sWhiteSpace);
+            bParsed = !sMode || !strcmp(sMode, "on") || !strcmp(sMode, "off");
+            if (!bParsed)
+                cout << "Invalid mode.  Use \"planar on\" or \"planar off\"." << endl;
+            else
+            {
+                s_bPlanar = !sMode || !strcmp(sMode, "on");
+                if (pImage && s_bPlanar)
+                    pImage->To_Planar();
+                else if (pImage)
+                    pImage->To_Packed();
+            }// else
+
+            bResult = bParsed;
+            break;
+        }// PLANAR
+
+        case PRECISION:
+        {
+            // precision 8|16 -- 8 bits a channel between operations, or at
+            // least 16 (the float planes), rounded to 8 only to save or show
+            char* sBits = strtok(NULL, c_sWhiteSpace);
+            bParsed = sBits && (!strcmp(sBits, "8") || !strcmp(sBits, "16"));
+            if (!bParsed)
+                cout << "Invalid precision.  Use \"precision 8\" or \"precision 16\"." << endl;
+            else
+            {
+                s_bPlanar = !strcmp(sBits, "16");
+                if (pImage && s_bPlanar)
+                    pImage->To_Planar();
+                else if (pImage)
+                    pImage->To_Packed();
+            }// else
+
+            bResult = bParsed;
+            break;
+        }// PRECISION
+
+        case LEVELS:
+        case GAMMA:
+        case CURVE:
+        {
+            PointLUT lut;
+            bParsed = ParseTone(command, lut);
+            if (!bParsed)
+                cout << "Invalid arguments.  Use \"levels black white [gamma]\", \"gamma gamma\" or \"curve x y x y ...\"." << endl;
+            else
+                lut.Apply(s_bRoi ? pImage->View(s_aRoi[0], s_aRoi[1], s_aRoi[2], s_aRoi[3]) : pImage->View());
+
+            bResult = bParsed;
+            break;
+        }// LEVELS, GAMMA, CURVE
+
         default:
         {
             cout << "Unable to parse command:  " << sCommand << endl;
@@ -454,15 +923,81 @@ bool CScriptHandler::HandleScriptFile(const char* sFilename, TargaImage*& pImage
 
     bool bResult = true;
     char sLine[c_maxLineLength + 1];
-    while (!inFile.eof() && bResult)
+    char sNext[c_maxLineLength + 1];
+    bool bHaveNext = false;
+    while ((bHaveNext || !inFile.eof()) && bResult)
     {
-        inFile.getline(sLine, c_maxLineLength);
+        if (bHaveNext)
+        {
+            strcpy(sLine, sNext);
+            bHaveNext = false;
+        }// if
+        else
+        {
+            inFile.getline(sLine, c_maxLineLength);
+            if (inFile.eof())
+                break;
+        }// else
+
+        // a plain load followed by halves decodes straight to the smaller size
+        // (not while a region is set, where half is an error, nor with planes,
+        // where the halves keep more than 8 bits)
+        char sFilename[c_maxLineLength + 1];
+        int  nHalves = 0;
+        if (!s_bRoi && !s_bPlanar && IsPlainLoad(sLine, sFilename))
+        {
+            while (nHalves < 3)
+            {
+                inFile.getline(sNext, c_maxLineLength);
+                bHaveNext = !inFile.eof();
+                if (!bHaveNext || !IsHalf(sNext))
+                    break;
+
+                bHaveNext = false;
+                ++nHalves;
+            }// while
+        }// if
+
+        // and a run of point operations composes into one table, which goes
+        // through the image once rather than once each (not with planes,
+        // where gray works on them)
+        PointLUT lut, next;
+        int nOps = 0;
+        if (pImage && !s_bPlanar && PointLUTOf(sLine, lut))
+        {
+            for (nOps = 1; ; ++nOps)
+            {
+                inFile.getline(sNext, c_maxLineLength);
+                bHaveNext = !inFile.eof();
+                if (!bHaveNext || !PointLUTOf(sNext, next))
+                    break;
 
-        if (!inFile.eof())
+                lut = lut.Then(next);
+                bHaveNext = false;
+            }// for
+        }// if
+
+        if (nHalves)
+        {
+            ostringstream sReduced;
+            sReduced << "load " << sFilename << " " << (1 << nHalves);
+            bResult = HandleCommand(sReduced.str().c_str(), pImage);
+        }// if
+        else if (nOps > 1)
+            lut.Apply(s_bRoi ? pImage->View(s_aRoi[0], s_aRoi[1], s_aRoi[2], s_aRoi[3]) : pImage->View());
+        else
             bResult = HandleCommand(sLine, pImage);
     }// while
 
     inFile.close();
+
+    // everything the script saved is on disk by the time it's done
+    if (!CSaveQueue::Instance().Sync())
+    {
+        cout << "Not every image was saved." << endl;
+        bResult = false;
+    }// if
+
     return bResult;
 }// CScriptHandler
 
@@ -11,6 +11,9 @@
 
 #include "Globals.h"
 #include "TargaImage.h"
+#include "PixelPool.h"
+#include "PointLUT.h"
+#include "SaveQueue.h"
 #include "libtarga.h"
 #include <stdlib.h>
 #include <assert.h>
@@ -21,6 +24,13 @@
 #include <vector>
 #include <algorithm>
 #include <map>
+#include <atomic>
+
+// SSE2 is always there on x64, and on 32 bit x86 when the compiler is told to use it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TARGA_SSE2
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -44,22 +54,297 @@ double Binomial(int n, int s)
 }// Binomial
 
 
+// Sums up the red, green and blue of pixel x of a half size image from the
+// three rows around row 2y of the full size one, above first, before they're
+// stored.  Columns off either edge are mirrored.  Channel c of pixel n in a
+// row is row[n * step + c * gap], so this works on packed pixels and on planes
+// alike.
+template <class T>
+static inline void Half_Sums(const T* const rows[3], int step, size_t gap, int width, int x, float sum[3])
+{
+	static const float matrix[3][3] = {
+							{0.0625,0.125,0.0625},
+							{0.125,0.25,0.125},
+							{0.0625,0.125,0.0625}
+	};
+
+	sum[0] = sum[1] = sum[2] = 0;
+
+	for (int j = -1; j <= 1; j++)
+	{
+		for (int i = -1; i <= 1; i++)
+		{
+			int surround_x;
+			if (((2 * x + i) < 0) || ((2 * x + i) >= width))
+			{
+				surround_x = 2 * x - i;
+			}
+			else
+			{
+				surround_x = 2 * x + i;
+			}
+
+			sum[0] += rows[j + 1][surround_x * step] * matrix[i + 1][j + 1];
+			sum[1] += rows[j + 1][surround_x * step + gap] * matrix[i + 1][j + 1];
+			sum[2] += rows[j + 1][surround_x * step + 2 * gap] * matrix[i + 1][j + 1];
+		}
+	}
+}// Half_Sums
+
+
+// Computes one row of a half size image from the three rows around row 2y of
+// the full size one, above first.  Columns off either edge are mirrored.
+static void Half_Row(const unsigned char* const rows[3], int width, unsigned char* out)
+{
+	for (int x = 0; x < width / 2; x++)
+	{
+		float sum[3];
+
+		Half_Sums(rows, 4, 1, width, x, sum);
+
+		out[x * 4] = sum[0];
+		out[x * 4 + 1] = sum[1];
+		out[x * 4 + 2] = sum[2];
+		out[x * 4 + 3] = 255;
+	}
+}// Half_Row
+
+
+// One Half_Size step applied to rows as they stream past, top first.  Each row
+// of the half size image comes out as soon as the row below its center arrives,
+// so only two rows of the larger image are ever kept.
+struct Half_Stream
+{
+	int width;                      // width of the rows coming in
+	int received;                   // rows taken so far
+	vector<unsigned char> above;    // row 2y - 1
+	vector<unsigned char> center;   // row 2y
+	vector<unsigned char> out;      // row y of the half size image
+
+	Half_Stream(int w) : width(w), received(0), above(w * 4), center(w * 4), out((w / 2) * 4) {}
+
+	// Take the next row, returning the finished half size row or NULL if there isn't one yet.
+	const unsigned char* Push(const unsigned char* row)
+	{
+		int r = received++;
+
+		if (r % 2 == 0)
+		{
+			memcpy(&center[0], row, width * 4);
+			return NULL;
+		}// if
+
+		// the row above row 0 mirrors to row 1
+		const unsigned char* rows[3] = { r == 1 ? row : &above[0], &center[0], row };
+		Half_Row(rows, width, &out[0]);
+		memcpy(&above[0], row, width * 4);
+		return &out[0];
+	}// Push
+};// Half_Stream
+
+
+// Spreads n 8 bit RGBA pixels out into the red, green, blue and alpha planes,
+// each planeSize floats after the last, as 0 to 1.
+static void Unpack_Row(const unsigned char* in, int n, float* planes, size_t planeSize)
+{
+	for (int c = 0; c < 4; c++)
+	{
+		float* out = planes + c * planeSize;
+		for (int x = 0; x < n; x++)
+			out[x] = in[x * 4 + c] / 255.0;
+	}
+}// Unpack_Row
+
+
+// Packs n pixels from the planes back into 8 bit RGBA, rounding to the nearest
+// level.
+static void Pack_Row(const float* planes, size_t planeSize, int n, unsigned char* out)
+{
+	for (int c = 0; c < 4; c++)
+	{
+		const float* in = planes + c * planeSize;
+		for (int x = 0; x < n; x++)
+		{
+			float v = in[x] * 255.0f + 0.5f;
+			out[x * 4 + c] = v <= 0 ? 0 : (v >= 255 ? 255 : (unsigned char)v);
+		}
+	}
+}// Pack_Row
+
+
+// Copies n opaque RGBA pixels to RGB, which is all tga_unpremultiply_rgb
+// comes to when every alpha is 255.
+static void Drop_Alpha(unsigned char* rgb, const unsigned char* rgba, int n)
+{
+	for (int x = 0; x < n; x++)
+	{
+		rgb[x * 3] = rgba[x * 4];
+		rgb[x * 3 + 1] = rgba[x * 4 + 1];
+		rgb[x * 3 + 2] = rgba[x * 4 + 2];
+	}
+}// Drop_Alpha
+
+
+// Returns the index i steps from x along a line of n, mirrored back in at the
+// ends like the 8 bit filters do.  Lines too short to mirror in are clamped.
+static inline int Mirror(int x, int i, int n)
+{
+	int m = (x + i < 0 || x + i >= n) ? x - i : x + i;
+
+	return m < 0 ? 0 : (m >= n ? n - 1 : m);
+}// Mirror
+
+
+// Filters one plane with a separable 5 tap kernel, across each row into
+// scratch and then down each column back into the plane.
+static void Filter_Plane(float* plane, int width, int height, const float taps[5], float* scratch)
+{
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < height; y++)
+	{
+		const float* in = plane + (size_t)y * width;
+		float* out = scratch + (size_t)y * width;
+
+		for (int x = 0; x < width; x++)
+		{
+			if (x < 2 || x >= width - 2)
+			{
+				float sum = 0;
+				for (int i = -2; i <= 2; i++)
+					sum += in[Mirror(x, i, width)] * taps[i + 2];
+				out[x] = sum;
+			}
+			else
+				out[x] = in[x - 2] * taps[0] + in[x - 1] * taps[1] + in[x] * taps[2] + in[x + 1] * taps[3] + in[x + 2] * taps[4];
+		}
+	}
+
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < height; y++)
+	{
+		const float* rows[5];
+		for (int j = -2; j <= 2; j++)
+			rows[j + 2] = scratch + (size_t)Mirror(y, j, height) * width;
+
+		float* out = plane + (size_t)y * width;
+		for (int x = 0; x < width; x++)
+			out[x] = rows[0][x] * taps[0] + rows[1][x] * taps[1] + rows[2][x] * taps[2] + rows[3][x] * taps[3] + rows[4][x] * taps[4];
+	}
+}// Filter_Plane
+
+
+// Computes pixel (x, y) of a view filtered with the 5x5 kernel taps[j] * taps[i]
+// over divisor, mirroring the offsets that fall off the view's edges.
+static void Filter_5x5_Pixel(const ImageView& view, int x, int y, const int taps[5], int divisor, unsigned char* out)
+{
+	int sum_red = 0, sum_green = 0, sum_blue = 0;
+
+	for (int j = -2; j <= 2; j++)
+	{
+		const unsigned char* row = view.Row(Mirror(y, j, view.height));
+		for (int i = -2; i <= 2; i++)
+		{
+			const unsigned char* pixel = row + Mirror(x, i, view.width) * 4;
+			int weight = taps[j + 2] * taps[i + 2];
+
+			sum_red += pixel[0] * weight;
+			sum_green += pixel[1] * weight;
+			sum_blue += pixel[2] * weight;
+		}
+	}
+
+	out[0] = sum_red / divisor;
+	out[1] = sum_green / divisor;
+	out[2] = sum_blue / divisor;
+	out[3] = 255;
+}// Filter_5x5_Pixel
+
+
+// Filters a view with the 5x5 kernel taps[j] * taps[i] over divisor into a
+// packed, opaque block the size of the view.  Works a tile at a time: each
+// tile is copied out with a two pixel halo and run through separably, across
+// and then down, over that small buffer.  Pixels within two of the view's
+// edges, where the offsets mirror, are done one at a time instead.
+static void Filter_5x5(const ImageView& view, const int taps[5], int divisor, unsigned char* out)
+{
+	const int halo = 2;
+	TileIterator tiles(view.width, view.height);
+
+	#pragma omp parallel
+	{
+		vector<unsigned char> block((c_tileSize + 2 * halo) * (c_tileSize + 2 * halo) * 4);
+		vector<int> across((c_tileSize + 2 * halo) * c_tileSize * 3);
+
+		#pragma omp for schedule(dynamic)
+		for (int t = 0; t < tiles.Count(); t++)
+		{
+			ImageTile tile = tiles.Tile(t);
+			int blockWidth = tile.width + 2 * halo;
+
+			view.Read_Tile(tile, halo, &block[0]);
+
+			// sums across each row of the block, for every pixel in the tile's columns
+			for (int r = 0; r < tile.height + 2 * halo; r++)
+			{
+				const unsigned char* in = &block[r * blockWidth * 4];
+				int* sums = &across[r * tile.width * 3];
+
+				for (int x = 0; x < tile.width; x++)
+					for (int c = 0; c < 3; c++)
+						sums[x * 3 + c] = in[x * 4 + c] * taps[0] + in[(x + 1) * 4 + c] * taps[1] + in[(x + 2) * 4 + c] * taps[2]
+										+ in[(x + 3) * 4 + c] * taps[3] + in[(x + 4) * 4 + c] * taps[4];
+			}
+
+			// then down the columns
+			for (int y = 0; y < tile.height; y++)
+			{
+				int vy = tile.y + y;
+				unsigned char* dst = out + ((size_t)vy * view.width + tile.x) * 4;
+
+				for (int x = 0; x < tile.width; x++, dst += 4)
+				{
+					int vx = tile.x + x;
+					if (vx < halo || vy < halo || vx >= view.width - halo || vy >= view.height - halo)
+					{
+						Filter_5x5_Pixel(view, vx, vy, taps, divisor, dst);
+						continue;
+					}
+
+					for (int c = 0; c < 3; c++)
+					{
+						const int* sums = &across[(y * tile.width + x) * 3 + c];
+						int rowSize = tile.width * 3;
+
+						dst[c] = (sums[0] * taps[0] + sums[rowSize] * taps[1] + sums[2 * rowSize] * taps[2]
+								  + sums[3 * rowSize] * taps[3] + sums[4 * rowSize] * taps[4]) / divisor;
+					}
+					dst[3] = 255;
+				}
+			}
+		}
+	}
+}// Filter_5x5
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Constructor.  Initialize member variables.
 //
 ///////////////////////////////////////////////////////////////////////////////
-TargaImage::TargaImage() : width(0), height(0), data(NULL)
-{}// TargaImage
+TargaImage::TargaImage() : width(0), height(0), data(NULL), planes(NULL), alpha(ALPHA_UNKNOWN)
+{
+	New_Identity();
+}// TargaImage
 
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Constructor.  Initialize member variables.
 //
 ///////////////////////////////////////////////////////////////////////////////
-TargaImage::TargaImage(int w, int h) : width(w), height(h)
+TargaImage::TargaImage(int w, int h) : width(w), height(h), planes(NULL), alpha(ALPHA_UNKNOWN)
 {
-	data = new unsigned char[width * height * 4];
+	New_Identity();
+	data = PixelPool::Allocate(width * height * 4);
 	ClearToBlack();
 }// TargaImage
 
@@ -70,13 +355,14 @@ TargaImage::TargaImage(int w, int h) : width(w), height(h)
 //      Constructor.  Initialize member variables to values given.
 //
 ///////////////////////////////////////////////////////////////////////////////
-TargaImage::TargaImage(int w, int h, unsigned char* d)
+TargaImage::TargaImage(int w, int h, unsigned char* d) : planes(NULL), alpha(ALPHA_UNKNOWN)
 {
 	int i;
 
+	New_Identity();
 	width = w;
 	height = h;
-	data = new unsigned char[width * height * 4];
+	data = PixelPool::Allocate(width * height * 4);
 
 	for (i = 0; i < width * height * 4; i++)
 		data[i] = d[i];
@@ -84,19 +370,397 @@ TargaImage::TargaImage(int w, int h, unsigned char* d)
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-//      Copy Constructor.  Initialize member to that of input
+//      Copy Constructor.  Shares the pixels of the input until either image
+//  changes them.
 //
 ///////////////////////////////////////////////////////////////////////////////
-TargaImage::TargaImage(const TargaImage& image)
+TargaImage::TargaImage(const TargaImage& image) : alpha(image.alpha)
 {
 	width = image.width;
 	height = image.height;
-	data = NULL;
-	if (image.data != NULL) {
-		data = new unsigned char[width * height * 4];
-		memcpy(data, image.data, sizeof(unsigned char) * width * height * 4);
+	data = PixelPool::Share(image.data);
+	planes = (float*)PixelPool::Share((unsigned char*)image.planes);
+	New_Identity();
+}// TargaImage
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Move Constructor.  Takes the pixels of the input, and the changes
+//  marked on them, leaving it empty.
+//
+///////////////////////////////////////////////////////////////////////////////
+TargaImage::TargaImage(TargaImage&& image) : width(image.width), height(image.height), data(image.data), planes(image.planes),
+	alpha(image.alpha), id(image.id), numChanges(image.numChanges), forgotten(image.forgotten)
+{
+	memcpy(changed, image.changed, sizeof(changed));
+
+	image.width = image.height = 0;
+	image.data = NULL;
+	image.planes = NULL;
+	image.alpha = ALPHA_UNKNOWN;
+	image.New_Identity();
+}// TargaImage
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Assignment.  Shares the pixels of the input like the copy constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+TargaImage& TargaImage::operator=(const TargaImage& image)
+{
+	unsigned char* shared = PixelPool::Share(image.data);
+	float* sharedPlanes = (float*)PixelPool::Share((unsigned char*)image.planes);
+
+	PixelPool::Release(data);
+	PixelPool::Release((unsigned char*)planes);
+	width = image.width;
+	height = image.height;
+	data = shared;
+	planes = sharedPlanes;
+	alpha = image.alpha;
+	New_Identity();
+
+	return *this;
+}// operator=
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Move assignment.  Takes the pixels of the input, and the changes
+//  marked on them, leaving it empty.
+//
+///////////////////////////////////////////////////////////////////////////////
+TargaImage& TargaImage::operator=(TargaImage&& image)
+{
+	if (this != &image)
+	{
+		PixelPool::Release(data);
+		PixelPool::Release((unsigned char*)planes);
+		width = image.width;
+		height = image.height;
+		data = image.data;
+		planes = image.planes;
+		alpha = image.alpha;
+		id = image.id;
+		numChanges = image.numChanges;
+		forgotten = image.forgotten;
+		memcpy(changed, image.changed, sizeof(changed));
+
+		image.width = image.height = 0;
+		image.data = NULL;
+		image.planes = NULL;
+		image.alpha = ALPHA_UNKNOWN;
+		image.New_Identity();
+	}// if
+
+	return *this;
+}// operator=
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Give this image its own copy of its pixels if any other image shares
+//  them, packing them back into data first if they're held as planes.
+//  Anything that writes to data must do this first, and mark what it
+//  changes; View does both for operations that work through views.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::Make_Writable()
+{
+	To_Packed();
+	if (!PixelPool::Is_Shared(data))
+		return;
+
+	unsigned char* own = PixelPool::Allocate(width * height * 4);
+	memcpy(own, data, width * height * 4);
+	PixelPool::Release(data);
+	data = own;
+}// Make_Writable
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Copy a tile of the view out into a packed block, along with halo pixels
+//  on every side.  Halo pixels off the view's edges repeat the edge pixels.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ImageView::Read_Tile(const ImageTile& tile, int halo, unsigned char* out) const
+{
+	int across = tile.width + 2 * halo;
+	int left = tile.x - halo;
+
+	// columns that fall inside the view, copied straight across
+	int first = max(left, 0), last = min(left + across, width);
+
+	for (int y = 0; y < tile.height + 2 * halo; y++)
+	{
+		const unsigned char* row = Row(min(max(tile.y - halo + y, 0), height - 1));
+		unsigned char* dst = out + y * across * 4;
+
+		for (int x = left; x < first; x++)
+			memcpy(dst + (x - left) * 4, row, 4);
+		if (last > first)
+			memcpy(dst + (first - left) * 4, row + first * 4, (last - first) * 4);
+		for (int x = max(last, first); x < left + across; x++)
+			memcpy(dst + (x - left) * 4, row + (width - 1) * 4, 4);
 	}
-}
+}// Read_Tile
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return a view of the whole image, marking all of it changed.
+//
+///////////////////////////////////////////////////////////////////////////////
+ImageView TargaImage::View()
+{
+	Make_Writable();
+	Mark_Changed();
+	return Read_View();
+}// View
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return a view of the whole image for reading only, without unsharing
+//  its pixels.  For operations that build a new block from it and swap that
+//  in with Replace_View.
+//
+///////////////////////////////////////////////////////////////////////////////
+ImageView TargaImage::Read_View()
+{
+	ImageView view;
+
+	To_Packed();
+
+	view.data = data;
+	view.width = width;
+	view.height = height;
+	view.stride = width * 4;
+
+	return view;
+}// Read_View
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return a view of the given rectangle of the image, clipped to the 
+//  image, and mark the rectangle changed.  A rectangle entirely outside
+//  gives an empty view.
+//
+///////////////////////////////////////////////////////////////////////////////
+ImageView TargaImage::View(int x, int y, int w, int h)
+{
+	int left = max(x, 0), top = max(y, 0);
+	int right = min(x + w, width), bottom = min(y + h, height);
+	ImageView view;
+
+	Make_Writable();
+	Mark_Changed(left, top, right - left, bottom - top);
+	view.width = max(right - left, 0);
+	view.height = max(bottom - top, 0);
+	view.stride = width * 4;
+
+	// an empty view still points into the image, not past it
+	if (view.width == 0 || view.height == 0)
+		view.data = data;
+	else
+		view.data = data + top * view.stride + left * 4;
+
+	return view;
+}// View
+
+
+// ids handed out to images so far
+static atomic<unsigned long long> lastImageId(0);
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Give the image a new id and an empty change log, so no stamp taken
+//  before counts for it.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::New_Identity()
+{
+	id = ++lastImageId;
+	numChanges = forgotten = 0;
+}// New_Identity
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Note that the whole image changed, which also covers any rectangles
+//  marked before.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::Mark_Changed()
+{
+	forgotten = ++numChanges;
+}// Mark_Changed
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Note that the given rectangle of the image changed.  Once the log is
+//  full the oldest rectangle drops out of it.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::Mark_Changed(int x, int y, int w, int h)
+{
+	int left = max(x, 0), top = max(y, 0);
+	int right = min(x + w, width), bottom = min(y + h, height);
+
+	if (right <= left || bottom <= top)
+		return;
+
+	ImageRect& rect = changed[++numChanges % c_changeLog];
+	rect.x = left;
+	rect.y = top;
+	rect.width = right - left;
+	rect.height = bottom - top;
+
+	if (numChanges > c_changeLog)
+		forgotten = max(forgotten, numChanges - c_changeLog);
+}// Mark_Changed
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return where the image's changes have got to, to pass to Changes_Since
+//  later.
+//
+///////////////////////////////////////////////////////////////////////////////
+ImageStamp TargaImage::Stamp() const
+{
+	ImageStamp stamp;
+
+	stamp.image = id;
+	stamp.change = numChanges;
+
+	return stamp;
+}// Stamp
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Fill in up to maxRects rectangles that between them cover everything
+//  changed since the stamp was taken, and return how many there are.  If
+//  there are more than that, the ones that grow least from it are merged.
+//  A stamp from another image, or from before a change to the whole image or
+//  one the log no longer holds, gives the whole image.
+//
+///////////////////////////////////////////////////////////////////////////////
+int TargaImage::Changes_Since(const ImageStamp& stamp, ImageRect* rects, int maxRects) const
+{
+	if (maxRects < 1 || width <= 0 || height <= 0)
+		return 0;
+
+	if (stamp.image != id || stamp.change < forgotten || stamp.change > numChanges)
+	{
+		rects[0].x = rects[0].y = 0;
+		rects[0].width = width;
+		rects[0].height = height;
+		return 1;
+	}// if
+
+	int count = 0;
+	for (unsigned long long n = stamp.change + 1; n <= numChanges; n++)
+	{
+		ImageRect rect = changed[n % c_changeLog];
+
+		// merge into whichever rectangle it adds least area to, or start a new one
+		int best = -1;
+		long long bestGrowth = 0;
+		for (int i = 0; i < count; i++)
+		{
+			int left = min(rects[i].x, rect.x), top = min(rects[i].y, rect.y);
+			int right = max(rects[i].x + rects[i].width, rect.x + rect.width);
+			int bottom = max(rects[i].y + rects[i].height, rect.y + rect.height);
+			long long growth = (long long)(right - left) * (bottom - top) - (long long)rects[i].width * rects[i].height;
+
+			if (best < 0 || growth < bestGrowth)
+			{
+				best = i;
+				bestGrowth = growth;
+			}// if
+		}// for
+
+		if (best >= 0 && (bestGrowth == 0 || count == maxRects))
+		{
+			int right = max(rects[best].x + rects[best].width, rect.x + rect.width);
+			int bottom = max(rects[best].y + rects[best].height, rect.y + rect.height);
+			rects[best].x = min(rects[best].x, rect.x);
+			rects[best].y = min(rects[best].y, rect.y);
+			rects[best].width = right - rects[best].x;
+			rects[best].height = bottom - rects[best].y;
+		}// if
+		else
+			rects[count++] = rect;
+	}// for
+
+	return count;
+}// Changes_Since
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return whether every pixel is fully opaque, looking through the alpha
+//  channel only if no operation since the last look has said.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Is_Opaque()
+{
+	if (alpha != ALPHA_UNKNOWN)
+		return alpha == ALPHA_OPAQUE;
+
+	const int block = 4096;		// pixels checked between looks at the answer
+	size_t count = (size_t)width * height;
+	bool opaque = data || planes;
+
+	for (size_t start = 0; start < count && opaque; start += block)
+	{
+		size_t end = min(start + block, count);
+		if (planes)
+		{
+			// whatever packs to 255
+			const float* in = planes + 3 * count;
+			for (size_t i = start; i < end; i++)
+				opaque = opaque && in[i] * 255.0f + 0.5f >= 255;
+		}// if
+		else
+		{
+			unsigned char all = 255;
+			for (size_t i = start; i < end; i++)
+				all &= data[i * 4 + 3];
+			opaque = all == 255;
+		}// else
+	}// for
+
+	alpha = opaque ? ALPHA_OPAQUE : ALPHA_TRANSLUCENT;
+	return opaque;
+}// Is_Opaque
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Note that every pixel in the view has alpha of the given kind now.
+//  For a view of part of the image, that settles the whole image only if the
+//  rest was opaque and so is the view, or the view is translucent.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::Set_Alpha(const ImageView& view, EAlpha state)
+{
+	if (view.width <= 0 || view.height <= 0)
+		return;
+
+	if ((view.width == width && view.height == height) || state == ALPHA_TRANSLUCENT)
+		alpha = state;
+	else if (state != ALPHA_OPAQUE || alpha != ALPHA_OPAQUE)
+		alpha = ALPHA_UNKNOWN;
+}// Set_Alpha
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -106,11 +770,92 @@ TargaImage::TargaImage(const TargaImage& image)
 ///////////////////////////////////////////////////////////////////////////////
 TargaImage::~TargaImage()
 {
-	if (data)
-		delete[] data;
+	PixelPool::Release(data);
+	PixelPool::Release((unsigned char*)planes);
 }// ~TargaImage
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return whether the pixels are held as float planes rather than in data.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Is_Planar() const
+{
+	return planes != NULL;
+}// Is_Planar
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Move the pixels out of data into float planes, where operations with a
+//  planar version keep them at full precision from one to the next.  Any
+//  other operation packs them back first.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::To_Planar()
+{
+	if (planes || !data)
+		return;
+
+	size_t planeSize = (size_t)width * height;
+	planes = (float*)PixelPool::Allocate(planeSize * 4 * sizeof(float));
+
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < height; y++)
+		Unpack_Row(data + (size_t)y * width * 4, width, planes + (size_t)y * width, planeSize);
+
+	PixelPool::Release(data);
+	data = NULL;
+}// To_Planar
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Move the pixels back into data as 8 bit RGBA if they're held as planes.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::To_Packed()
+{
+	if (!planes)
+		return;
+
+	size_t planeSize = (size_t)width * height;
+	data = PixelPool::Allocate(planeSize * 4);
+
+	#pragma omp parallel for schedule(static)
+	for (int y = 0; y < height; y++)
+		Pack_Row(planes + (size_t)y * width, planeSize, width, data + (size_t)y * width * 4);
+
+	PixelPool::Release((unsigned char*)planes);
+	planes = NULL;
+}// To_Packed
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Return one plane of a planar image to write to, unsharing the planes
+//  first if need be, and mark the image changed.  Channels are RED, GREEN,
+//  BLUE and 3 for alpha.
+//
+///////////////////////////////////////////////////////////////////////////////
+float* TargaImage::Plane(int channel)
+{
+	size_t planeSize = (size_t)width * height;
+
+	if (PixelPool::Is_Shared((unsigned char*)planes))
+	{
+		float* own = (float*)PixelPool::Allocate(planeSize * 4 * sizeof(float));
+		memcpy(own, planes, planeSize * 4 * sizeof(float));
+		PixelPool::Release((unsigned char*)planes);
+		planes = own;
+	}// if
+
+	Mark_Changed();
+	return planes + channel * planeSize;
+}// Plane
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Converts an image to RGB form, and returns the rgb pixel data - 24 
@@ -120,26 +865,84 @@ TargaImage::~TargaImage()
 ///////////////////////////////////////////////////////////////////////////////
 unsigned char* TargaImage::To_RGB(void)
 {
+	if (!data && !planes)
+		return NULL;
+
 	unsigned char* rgb = new unsigned char[width * height * 3];
-	int		    i, j;
+	ImageRect whole = { 0, 0, width, height };
 
-	if (!data)
-		return NULL;
+	To_RGB(rgb, whole);
+	return rgb;
+}// To_RGB
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Convert just the given rectangle into rgb, a width * height buffer from
+//  To_RGB, leaving the rest of it alone.  For bringing a conversion up to date
+//  with the changes since it was made.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::To_RGB(unsigned char* rgb, const ImageRect& rect)
+{
+	if (!data && !planes)
+		return;
 
-	// Divide out the alpha
-	for (i = 0; i < height; i++)
+	// Divide out the alpha, unless it's all 255 and there's nothing to divide
+	void (*convert)(unsigned char*, const unsigned char*, int) = Is_Opaque() ? Drop_Alpha : tga_unpremultiply_rgb;
+
+	#pragma omp parallel
 	{
-		int in_offset = i * width * 4;
-		int out_offset = i * width * 3;
+		vector<unsigned char> packed(planes ? rect.width * 4 : 0);
 
-		for (j = 0; j < width; j++)
+		#pragma omp for schedule(static)
+		for (int i = rect.y; i < rect.y + rect.height; i++)
 		{
-			RGBA_To_RGB(data + (in_offset + j * 4), rgb + (out_offset + j * 3));
+			size_t in_offset = ((size_t)i * width + rect.x) * 4;
+			size_t out_offset = ((size_t)i * width + rect.x) * 3;
+
+			if (planes)
+			{
+				Pack_Row(planes + (size_t)i * width + rect.x, (size_t)width * height, rect.width, packed.data());
+				convert(rgb + out_offset, packed.data(), rect.width);
+			}
+			else
+				convert(rgb + out_offset, data + in_offset, rect.width);
 		}
 	}
+}// To_RGB
 
-	return rgb;
-}// TargaImage
+
+// Writes rows top to top + count - 1 of the image out through the writer, a
+// band at a time, so the writer only ever stages a band's worth of the file.
+static bool Write_Rows(TargaImage& image, tga_writer* tga, int top, int count)
+{
+	const int band = 64;
+
+	tga_write_opaque(tga, image.Is_Opaque());
+	if (!image.planes)
+	{
+		bool bResult = true;
+		for (int y = top; y < top + count && bResult; y += band)
+			bResult = tga_write_rows(tga, y, min(band, top + count - y), image.data + (size_t)y * image.width * 4) != 0;
+		return bResult;
+	}// if
+
+	// pack a band of rows at a time rather than the whole image
+	unsigned char* rows = PixelPool::Allocate(image.width * band * 4);
+	bool bResult = true;
+
+	for (int y = top; y < top + count && bResult; y += band)
+	{
+		int n = min(band, top + count - y);
+		for (int i = 0; i < n; i++)
+			Pack_Row(image.planes + (size_t)(y + i) * image.width, (size_t)image.width * image.height, image.width, rows + i * image.width * 4);
+		bResult = tga_write_rows(tga, y, n, rows) != 0;
+	}// for
+
+	PixelPool::Release(rows);
+	return bResult;
+}// Write_Rows
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -149,35 +952,79 @@ unsigned char* TargaImage::To_RGB(void)
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Save_Image(const char* filename)
 {
-	TargaImage* out_image = Reverse_Rows();
+	tga_writer* tga;
 
-	if (!out_image)
+	if (!data && !planes)
 		return false;
 
-	if (!tga_write_raw(filename, width, height, out_image->data, TGA_TRUECOLOR_32))
+	// The file is stored bottom-up; the writer lays our top-down rows out
+	// that way as it converts them, so there's no flipped copy to make.
+	tga = tga_begin_write(filename, width, height, TGA_TRUECOLOR_32);
+	if (!tga)
 	{
-		cout << "TGA Save Error: %s\n", tga_error_string(tga_get_last_error());
+		cout << "TGA Save Error: " << tga_error_string(tga_get_last_error()) << endl;
 		return false;
 	}
 
-	delete out_image;
+	bool bResult = Write_Rows(*this, tga, 0, height);
+	bResult = tga_end_write(tga) && bResult;
+	if (!bResult)
+	{
+		cout << "TGA Save Error: " << tga_error_string(tga_get_last_error()) << endl;
+		return false;
+	}
 
 	return true;
 }// Save_Image
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Rewrite rows top to top + count - 1 of a file, in place, leaving the
+//  rest as it is.  The file must be uncompressed and laid out just as
+//  Save_Image writes an image this size; anything else is left alone and
+//  false returned, quietly, so the caller can save the whole image instead.
+//  Returns true on success.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Update_Image(const char* filename, int top, int count)
+{
+	if ((!data && !planes) || top < 0 || count < 0 || top + count > height)
+		return false;
+
+	tga_writer* tga = tga_begin_update(filename, width, height, TGA_TRUECOLOR_32);
+	if (!tga)
+		return false;
+
+	bool bResult = Write_Rows(*this, tga, top, count);
+	bResult = tga_end_write(tga) && bResult;
+	if (!bResult)
+	{
+		cout << "TGA Save Error: " << tga_error_string(tga_get_last_error()) << endl;
+		return false;
+	}
+
+	return true;
+}// Update_Image
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Load a targa image from a file.  Return a new TargaImage object which 
 //  must be deleted by caller.  Return NULL on failure.
 //
+//      A reduce of 2, 4 or 8 gives the image Half_Size would leave after
+//  running 1, 2 or 3 times, built as the rows are read so the full size image
+//  is never held in memory.
+//
 ///////////////////////////////////////////////////////////////////////////////
-TargaImage* TargaImage::Load_Image(char* filename)
+TargaImage* TargaImage::Load_Image(char* filename, int reduce)
 {
-	unsigned char* temp_data;
-	TargaImage* temp_image;
+	const int		band = 16;	// rows decoded at a time when reducing
+	tga_reader* tga;
 	TargaImage* result;
 	int		        width, height;
+	int			halvings;
 
 	if (!filename)
 	{
@@ -185,24 +1032,270 @@ TargaImage* TargaImage::Load_Image(char* filename)
 		return NULL;
 	}// if
 
-	temp_data = (unsigned char*)tga_load(filename, &width, &height, TGA_TRUECOLOR_32);
-	if (!temp_data)
+	for (halvings = 0; (1 << halvings) < reduce; halvings++)
+		;
+	if (reduce < 1 || (1 << halvings) != reduce || halvings > 3)
+	{
+		cout << "Invalid reduction factor:  " << reduce << endl;
+		return NULL;
+	}// if
+
+	// Decode straight into the new image, top row first, so there's no
+	// intermediate copy to flip.
+	tga = tga_open(filename, &width, &height);
+	if (!tga)
 	{
-		cout << "TGA Error: %s\n", tga_error_string(tga_get_last_error());
-		width = height = 0;
+		cout << "TGA Error: " << tga_error_string(tga_get_last_error()) << endl;
 		return NULL;
 	}
-	temp_image = new TargaImage(width, height, temp_data);
-	free(temp_data);
 
-	result = temp_image->Reverse_Rows();
+	result = new TargaImage();
+	result->width = width >> halvings;
+	result->height = height >> halvings;
+	result->data = PixelPool::Allocate(result->width * result->height * 4);
+
+	if (!halvings)
+	{
+		if (!tga_read_rows(tga, 0, height, result->data, TGA_TRUECOLOR_32))
+		{
+			cout << "TGA Error: " << tga_error_string(tga_get_last_error()) << endl;
+			tga_close(tga);
+			delete result;
+			return NULL;
+		}
+
+		// settle the alpha now, from the header if it can say
+		result->alpha = tga_opaque(tga) ? ALPHA_OPAQUE : ALPHA_UNKNOWN;
+		result->Is_Opaque();
+		tga_close(tga);
+
+		return result;
+	}// if
+
+	if (!result->width || !result->height)
+	{
+		tga_close(tga);
+		return result;
+	}// if
+
+	// Otherwise read a band of rows at a time and pass each one down the
+	// chain of halvings, keeping whatever falls out of the last.
+	vector<Half_Stream> stages;
+	for (int i = 0; i < halvings; i++)
+		stages.push_back(Half_Stream(width >> i));
+
+	vector<unsigned char> rows(band * width * 4);
+	int done = 0;
+
+	for (int y = 0; y < height; y += band)
+	{
+		int count = min(band, height - y);
+		if (!tga_read_rows(tga, y, count, &rows[0], TGA_TRUECOLOR_32))
+		{
+			cout << "TGA Error: " << tga_error_string(tga_get_last_error()) << endl;
+			tga_close(tga);
+			delete result;
+			return NULL;
+		}
+
+		for (int r = 0; r < count; r++)
+		{
+			const unsigned char* row = &rows[r * width * 4];
+			for (int i = 0; i < halvings && row; i++)
+				row = stages[i].Push(row);
 
-	delete temp_image;
+			if (row && done < result->height)
+				memcpy(result->data + done++ * result->width * 4, row, result->width * 4);
+		}// for
+	}// for
+	tga_close(tga);
+
+	// halving leaves every pixel opaque
+	result->alpha = ALPHA_OPAQUE;
 
 	return result;
 }// Load_Image
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Read only the header of the given targa file and fill in its
+//  dimensions, depth, compression and origin, without decoding any pixels.
+//  Return success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Probe_Image(const char* filename, tga_info* info)
+{
+	if (!filename)
+	{
+		cout << "No filename given." << endl;
+		return false;
+	}// if
+
+	if (!tga_probe(filename, info))
+	{
+		cout << "TGA Error: " << tga_error_string(tga_get_last_error()) << endl;
+		return false;
+	}
+
+	return true;
+}// Probe_Image
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Read the input file a band of rows at a time, apply the given point
+//  operations to each band in turn and write it to the output file, so only
+//  bandRows rows are ever held in memory.  The operations must treat every
+//  pixel on its own (gray, quant-unif, dither-thresh, ...) for the result to
+//  match loading, running them and saving.  A Dither_Random in ops[i] runs
+//  with seeds[i], its noise keyed on rows of the file rather than the band,
+//  so it matches dither-rand with that seed on the loaded image.  The output
+//  can't be the input file.  Return success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Stream_Image(const char* inFile, const char* outFile, const PointOp* ops, const unsigned int* seeds,
+                              int numOps, int bandRows)
+{
+	const PointOp dither = &TargaImage::Dither_Random;
+	tga_reader* in;
+	tga_writer* out;
+	int		width, height;
+
+	if (!inFile || !outFile)
+	{
+		cout << "No filename given." << endl;
+		return false;
+	}// if
+
+	if (bandRows < 1)
+	{
+		cout << "Invalid band size:  " << bandRows << endl;
+		return false;
+	}// if
+
+	// the input is mapped while the output is written, so writing over it
+	// would pull the pixels out from under the reader
+	if (CSaveQueue::Same_File(inFile, outFile))
+	{
+		cout << "Unable to stream a file onto itself:  " << outFile << endl;
+		return false;
+	}// if
+
+	in = tga_open(inFile, &width, &height);
+	if (!in)
+	{
+		cout << "TGA Error: " << tga_error_string(tga_get_last_error()) << endl;
+		return false;
+	}
+
+	out = tga_begin_write(outFile, width, height, TGA_TRUECOLOR_32);
+	if (!out)
+	{
+		cout << "TGA Save Error: " << tga_error_string(tga_get_last_error()) << endl;
+		tga_close(in);
+		return false;
+	}
+
+	TargaImage band(width, min(bandRows, height));
+	bool bResult = true;
+
+	// the point operations leave alpha be, so an opaque file stays opaque
+	band.alpha = tga_opaque(in) ? ALPHA_OPAQUE : ALPHA_UNKNOWN;
+	tga_write_opaque(out, band.alpha == ALPHA_OPAQUE);
+
+	for (int y = 0; y < height && bResult; y += bandRows)
+	{
+		band.height = min(bandRows, height - y);
+
+		bResult = tga_read_rows(in, y, band.height, band.data, TGA_TRUECOLOR_32) != 0;
+		for (int i = 0; i < numOps && bResult; i++)
+		{
+			if (ops[i] == dither)
+				bResult = band.Dither_Random(band.View(), seeds[i], 0, y);
+			else
+				bResult = (band.*ops[i])(band.View());
+		}// for
+
+		bResult = bResult && tga_write_rows(out, y, band.height, band.data);
+	}// for
+
+	if (!tga_end_write(out) && bResult)
+	{
+		cout << "TGA Save Error: " << tga_error_string(tga_get_last_error()) << endl;
+		bResult = false;
+	}// if
+	tga_close(in);
+
+	return bResult;
+}// Stream_Image
+
+
+#ifdef TARGA_SSE2
+// The double sums for two pixels' red, green and blue in the low lanes.
+static inline __m128i Gray_Level_Double(__m128i r, __m128i g, __m128i b)
+{
+	__m128d I = _mm_mul_pd(_mm_cvtepi32_pd(r), _mm_set1_pd(0.299));
+	I = _mm_add_pd(I, _mm_mul_pd(_mm_cvtepi32_pd(g), _mm_set1_pd(0.587)));
+	I = _mm_add_pd(I, _mm_mul_pd(_mm_cvtepi32_pd(b), _mm_set1_pd(0.114)));
+
+	return _mm_cvttpd_epi32(I);
+}// Gray_Level_Double
+#endif
+
+
+// Turns a row of n pixels gray, four at a time where there's SSE2.  The
+// divide by 1000 is done in float, which is exact for sums this small.
+static void Gray_Row(unsigned char* row, int n)
+{
+	int x = 0;
+
+#ifdef TARGA_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weights = _mm_setr_epi16(299, 587, 114, 0, 299, 587, 114, 0);
+	const __m128i lowByte = _mm_set1_epi32(0xFF);
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 thousand = _mm_set1_ps(1000.0f);
+	const __m128 thousandth = _mm_set1_ps(0.001f);
+
+	for (; x + 4 <= n; x += 4)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(row + x * 4));
+
+		// red and green, then blue, of two pixels from each half
+		__m128 low = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights));
+		__m128 high = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights));
+		__m128i sum = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0))),
+		                            _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1))));
+
+		__m128 exact = _mm_cvtepi32_ps(sum);
+		__m128i level = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(exact, half), thousandth));
+		if (_mm_movemask_ps(_mm_cmpeq_ps(_mm_mul_ps(_mm_cvtepi32_ps(level), thousand), exact)))
+		{
+			// some sum is a multiple of 1000, so do all four in double
+			__m128i r = _mm_and_si128(pixels, lowByte);
+			__m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), lowByte);
+			__m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 16), lowByte);
+			level = _mm_unpacklo_epi64(Gray_Level_Double(r, g, b),
+			                           Gray_Level_Double(_mm_shuffle_epi32(r, _MM_SHUFFLE(3, 2, 3, 2)),
+			                                             _mm_shuffle_epi32(g, _MM_SHUFFLE(3, 2, 3, 2)),
+			                                             _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 2, 3, 2))));
+		}// if
+
+		__m128i gray = _mm_or_si128(level, _mm_or_si128(_mm_slli_epi32(level, 8), _mm_slli_epi32(level, 16)));
+		_mm_storeu_si128((__m128i*)(row + x * 4), _mm_or_si128(gray, _mm_and_si128(pixels, alpha)));
+	}// for
+#endif
+
+	for (; x < n; x++)
+	{
+		unsigned char* p = row + x * 4;
+		p[0] = p[1] = p[2] = (unsigned char)Gray_Level(p[0], p[1], p[2]);
+	}// for
+}// Gray_Row
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Convert image to grayscale.  Red, green, and blue channels should all 
@@ -212,20 +1305,30 @@ TargaImage* TargaImage::Load_Image(char* filename)
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::To_Grayscale()
 {
-	for (int i = 0; i < height; i++)
+	if (Is_Planar())
 	{
-		for (int j = 0; j < width; j++)
-		{
-			double I = 0;
-			I += data[(i * width + j) * 4] * 0.299;//R
-			I += data[(i * width + j) * 4 + 1] * 0.587;//G
-			I += data[(i * width + j) * 4 + 2] * 0.114;//B
-
-			data[(i * width + j) * 4] = I; //R
-			data[(i * width + j) * 4 + 1] = I; //G
-			data[(i * width + j) * 4 + 2] = I; //B
-		}
-	}
+		float* red = Plane(RED);
+		float* green = Plane(GREEN);
+		float* blue = Plane(BLUE);
+
+		#pragma omp parallel for schedule(static)
+		for (int i = 0; i < width * height; i++)
+			red[i] = green[i] = blue[i] = red[i] * 0.299f + green[i] * 0.587f + blue[i] * 0.114f;
+
+		return true;
+	}// if
+
+	return To_Grayscale(View());
+}// To_Grayscale
+
+
+// Same, in place on just the pixels the view covers.
+bool TargaImage::To_Grayscale(const ImageView& view)
+{
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < view.height; i++)
+		Gray_Row(view.Row(i), view.width);
+
 	return true;
 }// To_Grayscale
 
@@ -238,13 +1341,21 @@ bool TargaImage::To_Grayscale()
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Quant_Uniform()
 {
-	for (int i = 0; i < height; i++)
+	return Quant_Uniform(View());
+}// Quant_Uniform
+
+
+// Same, in place on just the pixels the view covers.
+bool TargaImage::Quant_Uniform(const ImageView& view)
+{
+	for (int i = 0; i < view.height; i++)
 	{
-		for (int j = 0; j < width; j++)
+		unsigned char* row = view.Row(i);
+		for (int j = 0; j < view.width; j++)
 		{
-			data[(i * width + j) * 4] &= 0xE0;//R
-			data[(i * width + j) * 4 + 1] &= 0xE0;//G
-			data[(i * width + j) * 4 + 2] &= 0xC0;//B 
+			row[j * 4] &= 0xE0;//R
+			row[j * 4 + 1] &= 0xE0;//G
+			row[j * 4 + 2] &= 0xC0;//B 
 		}
 	}
 	return true;
@@ -349,6 +1460,9 @@ bool TargaImage::Quant_Populosity()
 	map<RGB, unsigned int>list;
 	vector<pair<RGB, unsigned int>> sortList;
 
+	Make_Writable();
+	Mark_Changed();
+
 	for (int i = 0; i < height; i++)
 	{
 		for (int j = 0; j < width; j++)
@@ -377,7 +1491,9 @@ bool TargaImage::Quant_Populosity()
 
 	sort(sortList.begin(), sortList.end(), [](const pair<RGB, unsigned int>& p1, const pair<RGB, unsigned int>& p2) {return p1.second > p2.second; });
 
-	sortList.erase(sortList.begin() + 256, sortList.end());
+	// an image, or a region, may well have fewer than 256 colors to begin with
+	if (sortList.size() > 256)
+		sortList.resize(256);
 
 	for (int i = 0; i < height; i++)
 	{
@@ -385,10 +1501,10 @@ bool TargaImage::Quant_Populosity()
 		{
 			bool FoundClosestColor = false;
 			RGB thisColor{ data[(i * width + j) * 4] ,data[(i * width + j) * 4 + 1] ,data[(i * width + j) * 4 + 2] };
-			RGB closestColor;
+			RGB closestColor = thisColor;
 			double minDistance = INFINITY;
 
-			for (int k = 0; k < 256; k++)
+			for (int k = 0; k < (int)sortList.size(); k++)
 			{
 				double distance = 0;
 
@@ -415,6 +1531,14 @@ bool TargaImage::Quant_Populosity()
 }// Quant_Populosity
 
 
+// Same for a rectangle -- the palette comes from the rectangle alone, so it
+// works on a packed copy of it.
+bool TargaImage::Quant_Populosity(const ImageView& view)
+{
+	return Run_On_Copy(view, &TargaImage::Quant_Populosity);
+}// Quant_Populosity
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Dither the image using a threshold of 1/2.  Return success of operation.
@@ -422,35 +1546,50 @@ bool TargaImage::Quant_Populosity()
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Dither_Threshold()
 {
-	if (this->To_Grayscale())
+	return Dither_Threshold(View());
+}// Dither_Threshold
+
+
+// Same, in place on just the pixels the view covers.
+bool TargaImage::Dither_Threshold(const ImageView& view)
+{
+	// each row goes gray and through the threshold while it's in cache
+	for (int i = 0; i < view.height; i++)
 	{
-		for (int i = 0; i < height; i++)
+		unsigned char* row = view.Row(i);
+		Gray_Row(row, view.width);
+		for (int j = 0; j < view.width; j++)
 		{
-			for (int j = 0; j < width; j++)
+			if (row[j * 4] > 127)
 			{
-				if (data[(i * width + j) * 4] > 127)
-				{
-					data[(i * width + j) * 4] = 255;
-					data[(i * width + j) * 4 + 1] = 255;
-					data[(i * width + j) * 4 + 2] = 255;
-				}
-				else
-				{
-					data[(i * width + j) * 4] = 0;
-					data[(i * width + j) * 4 + 1] = 0;
-					data[(i * width + j) * 4 + 2] = 0;
-				}
+				row[j * 4] = 255;
+				row[j * 4 + 1] = 255;
+				row[j * 4 + 2] = 255;
+			}
+			else
+			{
+				row[j * 4] = 0;
+				row[j * 4 + 1] = 0;
+				row[j * 4 + 2] = 0;
 			}
 		}
-		return true;
-	}
-	else
-	{
-		return false;
 	}
+	return true;
 }// Dither_Threshold
 
 
+// Mixes a 32 bit value into a well spread hash of it.
+static inline unsigned int Hash32(unsigned int h)
+{
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return h;
+}// Hash32
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Dither image using random dithering.  Return success of operation.
@@ -458,13 +1597,37 @@ bool TargaImage::Dither_Threshold()
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Dither_Random()
 {
-	if (this->To_Grayscale())
+	return Dither_Random(View());
+}// Dither_Random
+
+
+// Same, in place on the view, with a seed from rand().
+bool TargaImage::Dither_Random(const ImageView& view)
+{
+	return Dither_Random(view, (unsigned int)rand(), 0, 0);
+}// Dither_Random
+
+
+// Same, with the noise at each pixel a hash of the seed and the pixel's place
+// in the picture, given as the view's top left corner (left, top).  So it
+// comes out the same for a seed on any platform, rows can be done in any order,
+// and a rectangle or one of Stream_Image's bands gets what the whole image would.
+bool TargaImage::Dither_Random(const ImageView& view, unsigned int seed, int left, int top)
+{
+	if (this->To_Grayscale(view))
 	{
-		for (int i = 0; i < height; i++)
+		unsigned int key = Hash32(seed);
+
+		#pragma omp parallel for schedule(static)
+		for (int i = 0; i < view.height; i++)
 		{
-			for (int j = 0; j < width; j++)
+			unsigned char* row = view.Row(i);
+			unsigned int rowKey = Hash32(key ^ Hash32(top + i));
+			for (int j = 0; j < view.width; j++)
 			{
-				int temp = rand() % 103 - 51 + data[(i * width + j) * 4];
+				// -51 to 51, as rand() % 103 - 51 was
+				int noise = (int)((Hash32(rowKey + (left + j) * 0x9E3779B9u) >> 16) * 103 >> 16) - 51;
+				int temp = noise + row[j * 4];
 
 				if (temp > 127)
 				{
@@ -475,9 +1638,9 @@ bool TargaImage::Dither_Random()
 					temp = 0;
 				}
 
-				data[(i * width + j) * 4] = temp;
-				data[(i * width + j) * 4 + 1] = temp;
-				data[(i * width + j) * 4 + 2] = temp;
+				row[j * 4] = temp;
+				row[j * 4 + 1] = temp;
+				row[j * 4 + 2] = temp;
 			}
 		}
 
@@ -490,121 +1653,130 @@ bool TargaImage::Dither_Random()
 }// Dither_Random
 
 
-///////////////////////////////////////////////////////////////////////////////
-//
-//      Perform Floyd-Steinberg dithering on the image.  Return success of 
-//  operation.
-//
-///////////////////////////////////////////////////////////////////////////////
-bool TargaImage::Dither_FS()
+// Floyd-Steinberg dithers a gray plane of 0 to 1 values to 0 or 1, going
+// back and forth along the rows.
+static void Diffuse_FS(float* gray, int width, int height)
 {
-	if (this->To_Grayscale())
+	for (int y = 0; y < height; y++)
 	{
-		vector<vector<float>> new_data;  //left index :y , right index :x
+		float e; //error
 
-		for (int y = 0; y < height; y++)  //transform 
+		if (y % 2 == 0)
 		{
-			vector<float> temp;
-
 			for (int x = 0; x < width; x++)
 			{
-				temp.push_back(data[(y * width + x) * 4] / 255.0);
-			}
-			new_data.push_back(temp);
-		}
-
-		for (int y = 0; y < height; y++)
-		{
-			float e; //error
-
-			if (y % 2 == 0)
-			{
-				for (int x = 0; x < width; x++)
+				if (gray[y * width + x] > 0.5)
 				{
-					if (new_data[y][x] > 0.5)
-					{
-						e = new_data[y][x] - 1;
-						new_data[y][x] = 1;
-					}
-					else
-					{
-						e = new_data[y][x];
-						new_data[y][x] = 0;
-					}
+					e = gray[y * width + x] - 1;
+					gray[y * width + x] = 1;
+				}
+				else
+				{
+					e = gray[y * width + x];
+					gray[y * width + x] = 0;
+				}
 
-					if ((y + 1) < height)
+				if ((y + 1) < height)
+				{
+					if ((x - 1) >= 0)
 					{
-						if ((x - 1) >= 0)
-						{
-							new_data[y + 1][x - 1] += e * (3.0 / 16.0);
-						}
-						if ((x + 1) < width)
-						{
-							new_data[y + 1][x + 1] += e * (1.0 / 16.0);
-						}
-
-						new_data[y + 1][x] += e * (5.0 / 16.0);
+						gray[(y + 1) * width + x - 1] += e * (3.0 / 16.0);
 					}
 					if ((x + 1) < width)
 					{
-						new_data[y][x + 1] += e * (7.0 / 16.0);
+						gray[(y + 1) * width + x + 1] += e * (1.0 / 16.0);
 					}
+
+					gray[(y + 1) * width + x] += e * (5.0 / 16.0);
+				}
+				if ((x + 1) < width)
+				{
+					gray[y * width + x + 1] += e * (7.0 / 16.0);
 				}
 			}
-			else
+		}
+		else
+		{
+			for (int x = width - 1; x >= 0; x--)
 			{
-				for (int x = width - 1; x >= 0; x--)
+				if (gray[y * width + x] > 0.5)
+				{
+					e = gray[y * width + x] - 1;
+					gray[y * width + x] = 1;
+				}
+				else
+				{
+					e = gray[y * width + x];
+					gray[y * width + x] = 0;
+				}
+
+				if ((y + 1) < height)
 				{
-					if (new_data[y][x] > 0.5)
+					if ((x - 1) >= 0)
 					{
-						e = new_data[y][x] - 1;
-						new_data[y][x] = 1;
+						gray[(y + 1) * width + x - 1] += e * (1.0 / 16.0);
 					}
-					else
+					if ((x + 1) < width)
 					{
-						e = new_data[y][x];
-						new_data[y][x] = 0;
+						gray[(y + 1) * width + x + 1] += e * (3.0 / 16.0);
 					}
 
-					if ((y + 1) < height)
-					{
-						if ((x - 1) >= 0)
-						{
-							new_data[y + 1][x - 1] += e * (1.0 / 16.0);
-						}
-						if ((x + 1) < width)
-						{
-							new_data[y + 1][x + 1] += e * (3.0 / 16.0);
-						}
-
-						new_data[y + 1][x] += e * (5.0 / 16.0);
-					}
+					gray[(y + 1) * width + x] += e * (5.0 / 16.0);
+				}
 
-					if ((x - 1) >= 0)
-					{
-						new_data[y][x - 1] += e * (7.0 / 16.0);
-					}
+				if ((x - 1) >= 0)
+				{
+					gray[y * width + x - 1] += e * (7.0 / 16.0);
 				}
 			}
 		}
+	}
+}// Diffuse_FS
 
-		for (int y = 0; y < height; y++)  //restore
-		{
-			for (int x = 0; x < width; x++)
-			{
-				data[(y * width + x) * 4] = new_data[y][x] * 255;
-				data[(y * width + x) * 4 + 1] = new_data[y][x] * 255;
-				data[(y * width + x) * 4 + 2] = new_data[y][x] * 255;
-			}
-		}
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Perform Floyd-Steinberg dithering on the image.  Return success of 
+//  operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Dither_FS()
+{
+	if (!this->To_Grayscale())
+		return false;
+
+	if (Is_Planar())
+	{
+		float* gray = Plane(RED);
+		Diffuse_FS(gray, width, height);
+		memcpy(Plane(GREEN), gray, (size_t)width * height * sizeof(float));
+		memcpy(Plane(BLUE), gray, (size_t)width * height * sizeof(float));
 		return true;
-	}
-	else
+	}// if
+
+	vector<float> gray((size_t)width * height);
+
+	for (int i = 0; i < width * height; i++)  //transform
+		gray[i] = data[i * 4] / 255.0;
+
+	Diffuse_FS(gray.data(), width, height);
+
+	for (int i = 0; i < width * height; i++)  //restore
 	{
-		return false;
+		data[i * 4] = gray[i] * 255;
+		data[i * 4 + 1] = gray[i] * 255;
+		data[i * 4 + 2] = gray[i] * 255;
 	}
 
+	return true;
+}// Dither_FS
+
+
+// Same for a rectangle -- the error spreads along its rows, so it works on a
+// packed copy of it.
+bool TargaImage::Dither_FS(const ImageView& view)
+{
+	return Run_On_Copy(view, &TargaImage::Dither_FS);
 }// Dither_FS
 
 
@@ -616,13 +1788,20 @@ bool TargaImage::Dither_FS()
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Dither_Bright()
 {
-	if (this->To_Grayscale())
+	// a planar image goes gray in its planes; a packed one a row at a time as
+	// it's counted
+	bool planar = Is_Planar();
+	if (!planar || this->To_Grayscale())
 	{
+		Make_Writable();
+		Mark_Changed();
 		unsigned long long sum = 0;
 		unsigned long long table[256] = { 0 };
 
 		for (int i = 0; i < height; i++)
 		{
+			if (!planar)
+				Gray_Row(data + i * width * 4, width);
 			for (int j = 0; j < width; j++)
 			{
 				sum += data[(i * width + j) * 4];
@@ -671,77 +1850,161 @@ bool TargaImage::Dither_Bright()
 }// Dither_Bright
 
 
+// Same for a rectangle -- the brightness comes from the rectangle alone, so
+// it works on a packed copy of it.
+bool TargaImage::Dither_Bright(const ImageView& view)
+{
+	return Run_On_Copy(view, &TargaImage::Dither_Bright);
+}// Dither_Bright
+
+
+// Ordered dithers the view against a tile of thresholds, tileWidth by
+// tileHeight in rows, repeated from the view's corner: each pixel goes white
+// where its gray level is at least the threshold at its place and black
+// elsewhere.  Rows are turned gray first unless toGray is false, for pixels
+// that already are.  Each row of the tile is laid out across the whole width
+// first, so the compare runs straight along a row, 16 bytes at a time where
+// there's SSE2.
+static void Dither_Ordered(const ImageView& view, const unsigned char* tile, int tileWidth, int tileHeight, bool toGray)
+{
+	if (view.width <= 0 || view.height <= 0)
+		return;
+
+	int rowBytes = view.width * 4;
+	vector<unsigned char> thresholds((size_t)tileHeight * rowBytes);
+	for (int y = 0; y < tileHeight; y++)
+		for (int x = 0; x < view.width; x++)
+			memset(&thresholds[(size_t)y * rowBytes + x * 4], tile[y * tileWidth + x % tileWidth], 4);
+
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < view.height; i++)
+	{
+		unsigned char* row = view.Row(i);
+		const unsigned char* limit = &thresholds[(size_t)(i % tileHeight) * rowBytes];
+		int j = 0;
+
+		if (toGray)
+			Gray_Row(row, view.width);
+
+#ifdef TARGA_SSE2
+		const __m128i alpha = _mm_set1_epi32(0xFF000000);
+		for (; j + 16 <= rowBytes; j += 16)
+		{
+			__m128i pixels = _mm_loadu_si128((const __m128i*)(row + j));
+			__m128i white = _mm_cmpeq_epi8(_mm_max_epu8(pixels, _mm_loadu_si128((const __m128i*)(limit + j))), pixels);
+			_mm_storeu_si128((__m128i*)(row + j), _mm_or_si128(_mm_andnot_si128(alpha, white), _mm_and_si128(pixels, alpha)));
+		}// for
+#endif
+
+		for (; j < rowBytes; j += 4)
+			row[j] = row[j + 1] = row[j + 2] = row[j] >= limit[j] ? 255 : 0;
+	}// for
+}// Dither_Ordered
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
-//      Perform clustered differing of the image.  Return success of operation.
+//      Fill tile with the n by n Bayer matrix as thresholds, n being 2, 4, 8
+//  or 16.  Entry m of n * n goes to the first level above
+//  255 * (m + 1/2) / (n * n), so 0 always stays black and 255 white.
 //
 ///////////////////////////////////////////////////////////////////////////////
-bool TargaImage::Dither_Cluster()
+void TargaImage::Bayer_Tile(int n, unsigned char* tile)
 {
-	if (this->To_Grayscale())
-	{
-		const double matrix[4][4] = {
-										{0.7059,0.0588,0.4706,0.1765},
-										{0.3529,0.9412,0.7647,0.5294},
-										{0.5882,0.8235,0.8824,0.2941},
-										{0.2353,0.4118,0.1176,0.6471}
-		};
-
-		for (int i = 0; i < height; i++)
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++)
 		{
-			for (int j = 0; j < width; j++)
+			// 0 2 over 3 1 within each 2 x 2 cell, with the cells of each
+			// doubling ordered the same way in the lower digits
+			int m = 0;
+			for (int size = 1; size < n; size *= 2)
 			{
-				if (data[(i * width + j) * 4] >= (matrix[j % 4][i % 4] * 255))
-				{
-					data[(i * width + j) * 4] = 255;
-					data[(i * width + j) * 4 + 1] = 255;
-					data[(i * width + j) * 4 + 2] = 255;
-				}
-				else
-				{
-					data[(i * width + j) * 4] = 0;
-					data[(i * width + j) * 4 + 1] = 0;
-					data[(i * width + j) * 4 + 2] = 0;
-				}
-			}
-		}
+				int cx = x / size % 2, cy = y / size % 2;
+				m = m * 4 + (cy ? 3 - 2 * cx : 2 * cx);
+			}// for
 
-		return true;
-	}
-	else
-	{
-		return false;
-	}
+			tile[y * n + x] = (unsigned char)(255 * (2 * m + 1) / (2 * n * n) + 1);
+		}// for
+}// Bayer_Tile
 
-}// Dither_Cluster
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Fill a 4 x 4 tile with Dither_Cluster's thresholds.  A level reaches
+//  matrix[x][y] * 255 just when it's at least the ceiling of it.
+//
+///////////////////////////////////////////////////////////////////////////////
+void TargaImage::Cluster_Tile(unsigned char* tile)
+{
+	const double matrix[4][4] = {
+									{0.7059,0.0588,0.4706,0.1765},
+									{0.3529,0.9412,0.7647,0.5294},
+									{0.5882,0.8235,0.8824,0.2941},
+									{0.2353,0.4118,0.1176,0.6471}
+	};
+
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++)
+			tile[y * 4 + x] = (unsigned char)ceil(matrix[x][y] * 255);
+}// Cluster_Tile
 
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-//  Convert the image to an 8 bit image using Floyd-Steinberg dithering over
-//  a uniform quantization - the same quantization as in Quant_Uniform.
-//  Return success of operation.
+//      Ordered dither the image against a tile of thresholds, tileWidth by
+//  tileHeight in rows, repeated from the top left.  Each pixel goes white
+//  where its gray level is at least the threshold at its place, black
+//  elsewhere.  Return success of operation.
 //
 ///////////////////////////////////////////////////////////////////////////////
-bool TargaImage::Dither_Color()
+bool TargaImage::Dither_Pattern(const unsigned char* tile, int tileWidth, int tileHeight)
 {
-	vector<vector<float>> red_data, green_data, blue_data;  //left index :y , right index :x
+	return Dither_Pattern(View(), tile, tileWidth, tileHeight);
+}// Dither_Pattern
 
-	for (int y = 0; y < height; y++)  //transform
-	{
-		vector<float> temp_1, temp_2, temp_3;
 
-		for (int x = 0; x < width; x++)
-		{
-			temp_1.push_back(data[(y * width + x) * 4] / 255.0);
-			temp_2.push_back(data[(y * width + x) * 4 + 1] / 255.0);
-			temp_3.push_back(data[(y * width + x) * 4 + 2] / 255.0);
-		}
-		red_data.push_back(temp_1);
-		green_data.push_back(temp_2);
-		blue_data.push_back(temp_3);
-	}
+// Same, in place on the view, the tile repeating from its corner.
+bool TargaImage::Dither_Pattern(const ImageView& view, const unsigned char* tile, int tileWidth, int tileHeight)
+{
+	Dither_Ordered(view, tile, tileWidth, tileHeight, true);
+	return true;
+}// Dither_Pattern
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Perform clustered differing of the image.  Return success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Dither_Cluster()
+{
+	unsigned char tile[16];
+	Cluster_Tile(tile);
+
+	// a planar image goes gray in its planes; a packed one a row at a time
+	bool planar = Is_Planar();
+	if (planar && !To_Grayscale())
+		return false;
+
+	Dither_Ordered(View(), tile, 4, 4, !planar);
+	return true;
+}// Dither_Cluster
+
 
+// Same for a rectangle, the pattern lining up with its corner.
+bool TargaImage::Dither_Cluster(const ImageView& view)
+{
+	unsigned char tile[16];
+	Cluster_Tile(tile);
+
+	return Dither_Pattern(view, tile, 4, 4);
+}// Dither_Cluster
+
+
+// Floyd-Steinberg dithers red, green and blue planes of 0 to 1 values to 8,
+// 8 and 4 levels, going back and forth along the rows.
+static void Diffuse_Color(float* red, float* green, float* blue, int width, int height)
+{
 	for (int y = 0; y < height; y++)
 	{
 		float e_1, e_2, e_3; //error
@@ -751,58 +2014,58 @@ bool TargaImage::Dither_Color()
 		{
 			for (int x = 0; x < width; x++)
 			{
-				old_red = red_data[y][x];
-				old_green = green_data[y][x];
-				old_blue = blue_data[y][x];
-
-				if (red_data[y][x] < 18 / 255.0)  //red
-					red_data[y][x] = 0;
-				else if ((red_data[y][x] < 54.5 / 255.0))
-					red_data[y][x] = 36.0 / 255.0;
-				else if ((red_data[y][x] < 91.0 / 255.0))
-					red_data[y][x] = 73.0 / 255.0;
-				else if ((red_data[y][x] < 127.5 / 255.0))
-					red_data[y][x] = 109.0 / 255.0;
-				else if ((red_data[y][x] < 164.0 / 255.0))
-					red_data[y][x] = 146.0 / 255.0;
-				else if ((red_data[y][x] < 200.5 / 255.0))
-					red_data[y][x] = 182.0 / 255.0;
-				else if ((red_data[y][x] < 237.0 / 255.0))
-					red_data[y][x] = 219.0 / 255.0;
-				else if (red_data[y][x] >= 237.0 / 255.0)
-					red_data[y][x] = 1;
-
-				e_1 = old_red - red_data[y][x]; //red error
-
-				if (green_data[y][x] < 18.0 / 255.0)  //green
-					green_data[y][x] = 0;
-				else if ((green_data[y][x] < 54.5 / 255.0))
-					green_data[y][x] = 36.0 / 255.0;
-				else if ((green_data[y][x] < 91.0 / 255.0))
-					green_data[y][x] = 73.0 / 255.0;
-				else if ((green_data[y][x] < 127.5 / 255.0))
-					green_data[y][x] = 109.0 / 255.0;
-				else if ((green_data[y][x] < 164.0 / 255.0))
-					green_data[y][x] = 146.0 / 255.0;
-				else if ((green_data[y][x] < 200.5 / 255.0))
-					green_data[y][x] = 182.0 / 255.0;
-				else if ((green_data[y][x] < 237.0 / 255.0))
-					green_data[y][x] = 219.0 / 255.0;
-				else if (green_data[y][x] >= 237.0 / 255.0)
-					green_data[y][x] = 1;
-
-				e_2 = old_green - green_data[y][x];  //green error
-
-				if (blue_data[y][x] < 42.5 / 255.0) //blue
-					blue_data[y][x] = 0;
-				else if ((blue_data[y][x] < 127.5 / 255.0))
-					blue_data[y][x] = 85.0 / 255.0;
-				else if ((blue_data[y][x] < 212.5 / 255.0))
-					blue_data[y][x] = 170.0 / 255.0;
-				else if (blue_data[y][x] >= (212.5 / 255.0))
-					blue_data[y][x] = 1;
-
-				e_3 = old_blue - blue_data[y][x];  //blue error
+				old_red = red[y * width + x];
+				old_green = green[y * width + x];
+				old_blue = blue[y * width + x];
+
+				if (red[y * width + x] < 18 / 255.0)  //red
+					red[y * width + x] = 0;
+				else if ((red[y * width + x] < 54.5 / 255.0))
+					red[y * width + x] = 36.0 / 255.0;
+				else if ((red[y * width + x] < 91.0 / 255.0))
+					red[y * width + x] = 73.0 / 255.0;
+				else if ((red[y * width + x] < 127.5 / 255.0))
+					red[y * width + x] = 109.0 / 255.0;
+				else if ((red[y * width + x] < 164.0 / 255.0))
+					red[y * width + x] = 146.0 / 255.0;
+				else if ((red[y * width + x] < 200.5 / 255.0))
+					red[y * width + x] = 182.0 / 255.0;
+				else if ((red[y * width + x] < 237.0 / 255.0))
+					red[y * width + x] = 219.0 / 255.0;
+				else if (red[y * width + x] >= 237.0 / 255.0)
+					red[y * width + x] = 1;
+
+				e_1 = old_red - red[y * width + x]; //red error
+
+				if (green[y * width + x] < 18.0 / 255.0)  //green
+					green[y * width + x] = 0;
+				else if ((green[y * width + x] < 54.5 / 255.0))
+					green[y * width + x] = 36.0 / 255.0;
+				else if ((green[y * width + x] < 91.0 / 255.0))
+					green[y * width + x] = 73.0 / 255.0;
+				else if ((green[y * width + x] < 127.5 / 255.0))
+					green[y * width + x] = 109.0 / 255.0;
+				else if ((green[y * width + x] < 164.0 / 255.0))
+					green[y * width + x] = 146.0 / 255.0;
+				else if ((green[y * width + x] < 200.5 / 255.0))
+					green[y * width + x] = 182.0 / 255.0;
+				else if ((green[y * width + x] < 237.0 / 255.0))
+					green[y * width + x] = 219.0 / 255.0;
+				else if (green[y * width + x] >= 237.0 / 255.0)
+					green[y * width + x] = 1;
+
+				e_2 = old_green - green[y * width + x];  //green error
+
+				if (blue[y * width + x] < 42.5 / 255.0) //blue
+					blue[y * width + x] = 0;
+				else if ((blue[y * width + x] < 127.5 / 255.0))
+					blue[y * width + x] = 85.0 / 255.0;
+				else if ((blue[y * width + x] < 212.5 / 255.0))
+					blue[y * width + x] = 170.0 / 255.0;
+				else if (blue[y * width + x] >= (212.5 / 255.0))
+					blue[y * width + x] = 1;
+
+				e_3 = old_blue - blue[y * width + x];  //blue error
 
 
 
@@ -810,26 +2073,26 @@ bool TargaImage::Dither_Color()
 				{
 					if ((x - 1) >= 0)
 					{
-						red_data[y + 1][x - 1] += e_1 * (3.0 / 16.0);
-						green_data[y + 1][x - 1] += e_2 * (3.0 / 16.0);
-						blue_data[y + 1][x - 1] += e_3 * (3.0 / 16.0);
+						red[(y + 1) * width + x - 1] += e_1 * (3.0 / 16.0);
+						green[(y + 1) * width + x - 1] += e_2 * (3.0 / 16.0);
+						blue[(y + 1) * width + x - 1] += e_3 * (3.0 / 16.0);
 					}
 					if ((x + 1) < width)
 					{
-						red_data[y + 1][x + 1] += e_1 * (1.0 / 16.0);
-						green_data[y + 1][x + 1] += e_2 * (1.0 / 16.0);
-						blue_data[y + 1][x + 1] += e_3 * (1.0 / 16.0);
+						red[(y + 1) * width + x + 1] += e_1 * (1.0 / 16.0);
+						green[(y + 1) * width + x + 1] += e_2 * (1.0 / 16.0);
+						blue[(y + 1) * width + x + 1] += e_3 * (1.0 / 16.0);
 					}
 
-					red_data[y + 1][x] += e_1 * (5.0 / 16.0);
-					green_data[y + 1][x] += e_2 * (5.0 / 16.0);
-					blue_data[y + 1][x] += e_3 * (5.0 / 16.0);
+					red[(y + 1) * width + x] += e_1 * (5.0 / 16.0);
+					green[(y + 1) * width + x] += e_2 * (5.0 / 16.0);
+					blue[(y + 1) * width + x] += e_3 * (5.0 / 16.0);
 				}
 				if ((x + 1) < width)
 				{
-					red_data[y][x + 1] += e_1 * (7.0 / 16.0);
-					green_data[y][x + 1] += e_2 * (7.0 / 16.0);
-					blue_data[y][x + 1] += e_3 * (7.0 / 16.0);
+					red[y * width + x + 1] += e_1 * (7.0 / 16.0);
+					green[y * width + x + 1] += e_2 * (7.0 / 16.0);
+					blue[y * width + x + 1] += e_3 * (7.0 / 16.0);
 				}
 			}
 		}
@@ -837,99 +2100,135 @@ bool TargaImage::Dither_Color()
 		{
 			for (int x = width - 1; x >= 0; x--)
 			{
-				old_red = red_data[y][x];
-				old_green = green_data[y][x];
-				old_blue = blue_data[y][x];
-
-				if (red_data[y][x] < 18.0 / 255.0)  //red
-					red_data[y][x] = 0;
-				else if ((red_data[y][x] < 54.5 / 255.0))
-					red_data[y][x] = 36.0 / 255.0;
-				else if ((red_data[y][x] < 91.0 / 255.0))
-					red_data[y][x] = 73.0 / 255.0;
-				else if ((red_data[y][x] < 127.5 / 255.0))
-					red_data[y][x] = 109.0 / 255.0;
-				else if ((red_data[y][x] < 164.0 / 255.0))
-					red_data[y][x] = 146.0 / 255.0;
-				else if ((red_data[y][x] < 200.5 / 255.0))
-					red_data[y][x] = 182.0 / 255.0;
-				else if ((red_data[y][x] < 237.0 / 255.0))
-					red_data[y][x] = 219.0 / 255.0;
-				else if (red_data[y][x] >= 237.0 / 255.0)
-					red_data[y][x] = 1;
-
-				e_1 = old_red - red_data[y][x]; //red error
-
-				if (green_data[y][x] < 18.0 / 255.0)  //green
-					green_data[y][x] = 0;
-				else if ((green_data[y][x] < 54.5 / 255.0))
-					green_data[y][x] = 36.0 / 255.0;
-				else if ((green_data[y][x] < 91.0 / 255.0))
-					green_data[y][x] = 73.0 / 255.0;
-				else if ((green_data[y][x] < 127.5 / 255.0))
-					green_data[y][x] = 109.0 / 255.0;
-				else if ((green_data[y][x] < 164.0 / 255.0))
-					green_data[y][x] = 146.0 / 255.0;
-				else if ((green_data[y][x] < 200.5 / 255.0))
-					green_data[y][x] = 182.0 / 255.0;
-				else if ((green_data[y][x] < 237.0 / 255.0))
-					green_data[y][x] = 219.0 / 255.0;
-				else if (green_data[y][x] >= 237.0 / 255.0)
-					green_data[y][x] = 1;
-
-				e_2 = old_green - green_data[y][x];  //green error
-
-				if (blue_data[y][x] < 42.5 / 255.0) //blue
-					blue_data[y][x] = 0;
-				else if ((blue_data[y][x] < 127.5 / 255.0))
-					blue_data[y][x] = 85.0 / 255.0;
-				else if ((blue_data[y][x] < 212.5 / 255.0))
-					blue_data[y][x] = 170.0 / 255.0;
-				else if (blue_data[y][x] >= (212.5 / 255.0))
-					blue_data[y][x] = 1;
-
-				e_3 = old_blue - blue_data[y][x];  //blue error
+				old_red = red[y * width + x];
+				old_green = green[y * width + x];
+				old_blue = blue[y * width + x];
+
+				if (red[y * width + x] < 18.0 / 255.0)  //red
+					red[y * width + x] = 0;
+				else if ((red[y * width + x] < 54.5 / 255.0))
+					red[y * width + x] = 36.0 / 255.0;
+				else if ((red[y * width + x] < 91.0 / 255.0))
+					red[y * width + x] = 73.0 / 255.0;
+				else if ((red[y * width + x] < 127.5 / 255.0))
+					red[y * width + x] = 109.0 / 255.0;
+				else if ((red[y * width + x] < 164.0 / 255.0))
+					red[y * width + x] = 146.0 / 255.0;
+				else if ((red[y * width + x] < 200.5 / 255.0))
+					red[y * width + x] = 182.0 / 255.0;
+				else if ((red[y * width + x] < 237.0 / 255.0))
+					red[y * width + x] = 219.0 / 255.0;
+				else if (red[y * width + x] >= 237.0 / 255.0)
+					red[y * width + x] = 1;
+
+				e_1 = old_red - red[y * width + x]; //red error
+
+				if (green[y * width + x] < 18.0 / 255.0)  //green
+					green[y * width + x] = 0;
+				else if ((green[y * width + x] < 54.5 / 255.0))
+					green[y * width + x] = 36.0 / 255.0;
+				else if ((green[y * width + x] < 91.0 / 255.0))
+					green[y * width + x] = 73.0 / 255.0;
+				else if ((green[y * width + x] < 127.5 / 255.0))
+					green[y * width + x] = 109.0 / 255.0;
+				else if ((green[y * width + x] < 164.0 / 255.0))
+					green[y * width + x] = 146.0 / 255.0;
+				else if ((green[y * width + x] < 200.5 / 255.0))
+					green[y * width + x] = 182.0 / 255.0;
+				else if ((green[y * width + x] < 237.0 / 255.0))
+					green[y * width + x] = 219.0 / 255.0;
+				else if (green[y * width + x] >= 237.0 / 255.0)
+					green[y * width + x] = 1;
+
+				e_2 = old_green - green[y * width + x];  //green error
+
+				if (blue[y * width + x] < 42.5 / 255.0) //blue
+					blue[y * width + x] = 0;
+				else if ((blue[y * width + x] < 127.5 / 255.0))
+					blue[y * width + x] = 85.0 / 255.0;
+				else if ((blue[y * width + x] < 212.5 / 255.0))
+					blue[y * width + x] = 170.0 / 255.0;
+				else if (blue[y * width + x] >= (212.5 / 255.0))
+					blue[y * width + x] = 1;
+
+				e_3 = old_blue - blue[y * width + x];  //blue error
 
 				if ((y + 1) < height)
 				{
 					if ((x - 1) >= 0)
 					{
-						red_data[y + 1][x - 1] += e_1 * (1.0 / 16.0);
-						green_data[y + 1][x - 1] += e_2 * (1.0 / 16.0);
-						blue_data[y + 1][x - 1] += e_3 * (1.0 / 16.0);
+						red[(y + 1) * width + x - 1] += e_1 * (1.0 / 16.0);
+						green[(y + 1) * width + x - 1] += e_2 * (1.0 / 16.0);
+						blue[(y + 1) * width + x - 1] += e_3 * (1.0 / 16.0);
 					}
 					if ((x + 1) < width)
 					{
-						red_data[y + 1][x + 1] += e_1 * (3.0 / 16.0);
-						green_data[y + 1][x + 1] += e_2 * (3.0 / 16.0);
-						blue_data[y + 1][x + 1] += e_3 * (3.0 / 16.0);
+						red[(y + 1) * width + x + 1] += e_1 * (3.0 / 16.0);
+						green[(y + 1) * width + x + 1] += e_2 * (3.0 / 16.0);
+						blue[(y + 1) * width + x + 1] += e_3 * (3.0 / 16.0);
 					}
 
-					red_data[y + 1][x] += e_1 * (5.0 / 16.0);
-					green_data[y + 1][x] += e_2 * (5.0 / 16.0);
-					blue_data[y + 1][x] += e_3 * (5.0 / 16.0);
+					red[(y + 1) * width + x] += e_1 * (5.0 / 16.0);
+					green[(y + 1) * width + x] += e_2 * (5.0 / 16.0);
+					blue[(y + 1) * width + x] += e_3 * (5.0 / 16.0);
 				}
 				if ((x - 1) >= 0)
 				{
-					red_data[y][x - 1] += e_1 * (7.0 / 16.0);
-					green_data[y][x - 1] += e_2 * (7.0 / 16.0);
-					blue_data[y][x - 1] += e_3 * (7.0 / 16.0);
+					red[y * width + x - 1] += e_1 * (7.0 / 16.0);
+					green[y * width + x - 1] += e_2 * (7.0 / 16.0);
+					blue[y * width + x - 1] += e_3 * (7.0 / 16.0);
 				}
 			}
 		}
 	}
+}// Diffuse_Color
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Convert the image to an 8 bit image using Floyd-Steinberg dithering over
+//  a uniform quantization - the same quantization as in Quant_Uniform.
+//  Return success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Dither_Color()
+{
+	if (Is_Planar())
+	{
+		Diffuse_Color(Plane(RED), Plane(GREEN), Plane(BLUE), width, height);
+		return true;
+	}// if
+
+	vector<float> red((size_t)width * height), green((size_t)width * height), blue((size_t)width * height);
+
+	Make_Writable();
+	Mark_Changed();
+
+	for (int i = 0; i < width * height; i++)  //transform
+	{
+		red[i] = data[i * 4] / 255.0;
+		green[i] = data[i * 4 + 1] / 255.0;
+		blue[i] = data[i * 4 + 2] / 255.0;
+	}
+
+	Diffuse_Color(red.data(), green.data(), blue.data(), width, height);
 
-	for (int y = 0; y < height; y++)  //restore
+	for (int i = 0; i < width * height; i++)  //restore
 	{
-		for (int x = 0; x < width; x++)
-		{
-			data[(y * width + x) * 4] = red_data[y][x] * 255;
-			data[(y * width + x) * 4 + 1] = green_data[y][x] * 255;
-			data[(y * width + x) * 4 + 2] = blue_data[y][x] * 255;
-		}
+		data[i * 4] = red[i] * 255;
+		data[i * 4 + 1] = green[i] * 255;
+		data[i * 4 + 2] = blue[i] * 255;
 	}
 
-	return true;
+	return true;
+}// Dither_Color
+
+
+// Same for a rectangle -- the error spreads along its rows, so it works on a
+// packed copy of it.
+bool TargaImage::Dither_Color(const ImageView& view)
+{
+	return Run_On_Copy(view, &TargaImage::Dither_Color);
 }// Dither_Color
 
 
@@ -1045,24 +2344,56 @@ bool TargaImage::Difference(TargaImage* pImage)
 		return false;
 	}// if
 
-	for (int i = 0; i < width * height * 4; i += 4)
+	vector<unsigned char> rgb1(width * 3), rgb2(width * 3);
+	void (*convert1)(unsigned char*, const unsigned char*, int) = Is_Opaque() ? Drop_Alpha : tga_unpremultiply_rgb;
+	void (*convert2)(unsigned char*, const unsigned char*, int) = pImage->Is_Opaque() ? Drop_Alpha : tga_unpremultiply_rgb;
+
+	Make_Writable();
+	Mark_Changed();
+	pImage->To_Packed();
+	for (int y = 0; y < height; y++)
 	{
-		unsigned char        rgb1[3];
-		unsigned char        rgb2[3];
+		unsigned char* row = data + y * width * 4;
 
-		RGBA_To_RGB(data + i, rgb1);
-		RGBA_To_RGB(pImage->data + i, rgb2);
+		convert1(&rgb1[0], row, width);
+		convert2(&rgb2[0], pImage->data + y * width * 4, width);
 
-		data[i] = abs(rgb1[0] - rgb2[0]);
-		data[i + 1] = abs(rgb1[1] - rgb2[1]);
-		data[i + 2] = abs(rgb1[2] - rgb2[2]);
-		data[i + 3] = 255;
+		for (int x = 0; x < width; x++)
+		{
+			row[x * 4] = abs(rgb1[x * 3] - rgb2[x * 3]);
+			row[x * 4 + 1] = abs(rgb1[x * 3 + 1] - rgb2[x * 3 + 1]);
+			row[x * 4 + 2] = abs(rgb1[x * 3 + 2] - rgb2[x * 3 + 2]);
+			row[x * 4 + 3] = 255;
+		}
 	}
+	alpha = ALPHA_OPAQUE;
 
 	return true;
 }// Difference
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Run a separable 5x5 filter over the color planes of a planar image,
+//  leaving it opaque the way the 8 bit filters do.  Return success of
+//  operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Filter_Planes(const float taps[5])
+{
+	vector<float> scratch((size_t)width * height);
+
+	for (int c = RED; c <= BLUE; c++)
+		Filter_Plane(Plane(c), width, height, taps, scratch.data());
+
+	float* opaque = Plane(3);
+	fill(opaque, opaque + (size_t)width * height, 1.0f);
+	alpha = ALPHA_OPAQUE;
+
+	return true;
+}// Filter_Planes
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //      Perform 5x5 box filter on this image.  Return success of operation.
@@ -1070,50 +2401,25 @@ bool TargaImage::Difference(TargaImage* pImage)
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Filter_Box()
 {
-	unsigned char* newImage = new unsigned char[width * height * 4];
-	for (int y = 0; y < height; y++)
+	if (Is_Planar())
 	{
-		for (int x = 0; x < width; x++)
-		{
-			int sum_red = 0, sum_green = 0, sum_blue = 0;
+		const float taps[5] = { 0.2f, 0.2f, 0.2f, 0.2f, 0.2f };
+		return Filter_Planes(taps);
+	}// if
 
-			for (int j = -2; j <= 2; j++)
-			{
-				for (int i = -2; i <= 2; i++)
-				{
-					int surround_x, surround_y;
-					if (((x + i) < 0) || ((x + i) >= width))
-					{
-						surround_x = x - i;
-					}
-					else
-					{
-						surround_x = x + i;
-					}
+	return Filter_Box(Read_View());
+}// Filter_Box
 
-					if (((y + j) < 0) || ((y + j) >= height))
-					{
-						surround_y = y - j;
-					}
-					else
-					{
-						surround_y = y + j;
-					}
 
-					sum_red += data[(surround_y * width + surround_x) * 4];
-					sum_green += data[(surround_y * width + surround_x) * 4 + 1];
-					sum_blue += data[(surround_y * width + surround_x) * 4 + 2];
-				}
-			}
-			newImage[(y * width + x) * 4] = sum_red / 25;
-			newImage[(y * width + x) * 4 + 1] = sum_green / 25;
-			newImage[(y * width + x) * 4 + 2] = sum_blue / 25;
-			newImage[(y * width + x) * 4 + 3] = 255;
-		}
-	}
+// Same for a rectangle, mirroring at its edges as at the image's.
+bool TargaImage::Filter_Box(const ImageView& view)
+{
+	const int taps[5] = { 1, 1, 1, 1, 1 };
+	unsigned char* newImage = PixelPool::Allocate(view.width * view.height * 4);
 
-	memcpy(data, newImage, sizeof(unsigned char) * width * height * 4);
-	delete[] newImage;
+	Filter_5x5(view, taps, 25, newImage);
+	Replace_View(view, newImage);
+	Set_Alpha(view, ALPHA_OPAQUE);
 
 	return true;
 }// Filter_Box
@@ -1127,57 +2433,25 @@ bool TargaImage::Filter_Box()
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Filter_Bartlett()
 {
-	unsigned char* newImage = new unsigned char[width * height * 4];
-	const int matrix[5][5] = {
-								{1,2,3,2,1},
-								{2,4,6,4,2},
-								{3,6,9,6,3},
-								{2,4,6,4,2},
-								{1,2,3,2,1}
-	};
-	for (int y = 0; y < height; y++)
+	if (Is_Planar())
 	{
-		for (int x = 0; x < width; x++)
-		{
-			int sum_red = 0, sum_green = 0, sum_blue = 0;
+		const float taps[5] = { 1 / 9.0f, 2 / 9.0f, 3 / 9.0f, 2 / 9.0f, 1 / 9.0f };
+		return Filter_Planes(taps);
+	}// if
 
-			for (int j = -2; j <= 2; j++)
-			{
-				for (int i = -2; i <= 2; i++)
-				{
-					int surround_x, surround_y;
-					if (((x + i) < 0) || ((x + i) >= width))
-					{
-						surround_x = x - i;
-					}
-					else
-					{
-						surround_x = x + i;
-					}
+	return Filter_Bartlett(Read_View());
+}// Filter_Bartlett
 
-					if (((y + j) < 0) || ((y + j) >= height))
-					{
-						surround_y = y - j;
-					}
-					else
-					{
-						surround_y = y + j;
-					}
 
-					sum_red += data[(surround_y * width + surround_x) * 4] * matrix[j + 2][i + 2];
-					sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix[j + 2][i + 2];
-					sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix[j + 2][i + 2];
-				}
-			}
-			newImage[(y * width + x) * 4] = sum_red / 81;
-			newImage[(y * width + x) * 4 + 1] = sum_green / 81;
-			newImage[(y * width + x) * 4 + 2] = sum_blue / 81;
-			newImage[(y * width + x) * 4 + 3] = 255;
-		}
-	}
+// Same for a rectangle, mirroring at its edges as at the image's.
+bool TargaImage::Filter_Bartlett(const ImageView& view)
+{
+	const int taps[5] = { 1, 2, 3, 2, 1 };
+	unsigned char* newImage = PixelPool::Allocate(view.width * view.height * 4);
 
-	memcpy(data, newImage, sizeof(unsigned char) * width * height * 4);
-	delete[] newImage;
+	Filter_5x5(view, taps, 81, newImage);
+	Replace_View(view, newImage);
+	Set_Alpha(view, ALPHA_OPAQUE);
 
 	return true;
 }// Filter_Bartlett
@@ -1191,57 +2465,25 @@ bool TargaImage::Filter_Bartlett()
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Filter_Gaussian()
 {
-	unsigned char* newImage = new unsigned char[width * height * 4];
-	const int matrix[5][5] = {
-								{1,4,6,4,1},
-								{4,16,24,16,4},
-								{6,24,36,24,6},
-								{4,16,24,16,4},
-								{1,4,6,4,1}
-	};
-	for (int y = 0; y < height; y++)
+	if (Is_Planar())
 	{
-		for (int x = 0; x < width; x++)
-		{
-			int sum_red = 0, sum_green = 0, sum_blue = 0;
+		const float taps[5] = { 1 / 16.0f, 4 / 16.0f, 6 / 16.0f, 4 / 16.0f, 1 / 16.0f };
+		return Filter_Planes(taps);
+	}// if
 
-			for (int j = -2; j <= 2; j++)
-			{
-				for (int i = -2; i <= 2; i++)
-				{
-					int surround_x, surround_y;
-					if (((x + i) < 0) || ((x + i) >= width))
-					{
-						surround_x = x - i;
-					}
-					else
-					{
-						surround_x = x + i;
-					}
+	return Filter_Gaussian(Read_View());
+}// Filter_Gaussian
 
-					if (((y + j) < 0) || ((y + j) >= height))
-					{
-						surround_y = y - j;
-					}
-					else
-					{
-						surround_y = y + j;
-					}
 
-					sum_red += data[(surround_y * width + surround_x) * 4] * matrix[j + 2][i + 2];
-					sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix[j + 2][i + 2];
-					sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix[j + 2][i + 2];
-				}
-			}
-			newImage[(y * width + x) * 4] = sum_red / 256;
-			newImage[(y * width + x) * 4 + 1] = sum_green / 256;
-			newImage[(y * width + x) * 4 + 2] = sum_blue / 256;
-			newImage[(y * width + x) * 4 + 3] = 255;
-		}
-	}
+// Same for a rectangle, mirroring at its edges as at the image's.
+bool TargaImage::Filter_Gaussian(const ImageView& view)
+{
+	const int taps[5] = { 1, 4, 6, 4, 1 };
+	unsigned char* newImage = PixelPool::Allocate(view.width * view.height * 4);
 
-	memcpy(data, newImage, sizeof(unsigned char) * width * height * 4);
-	delete[] newImage;
+	Filter_5x5(view, taps, 256, newImage);
+	Replace_View(view, newImage);
+	Set_Alpha(view, ALPHA_OPAQUE);
 
 	return true;
 }// Filter_Gaussian
@@ -1309,237 +2551,363 @@ bool TargaImage::NPR_Paint()
 ///////////////////////////////////////////////////////////////////////////////
 bool TargaImage::Half_Size()
 {
-	unsigned char* newImage = new unsigned char[(width / 2) * (height / 2) * 4];
-	float matrix[3][3] = {
-							{0.0625,0.125,0.0625},
-							{0.125,0.25,0.125},
-							{0.0625,0.125,0.0625}
-	};
-
-	for (int y = 0; y < height / 2; y++)
+	if (Is_Planar())
 	{
-		for (int x = 0; x < width / 2; x++)
-		{
-			float sum_red = 0, sum_green = 0, sum_blue = 0;
+		// the same filter on each plane, kept in float
+		size_t planeSize = (size_t)width * height, halfSize = (size_t)(width / 2) * (height / 2);
+		float* newPlanes = (float*)PixelPool::Allocate(halfSize * 4 * sizeof(float));
 
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < height / 2; y++)
+		{
+			const float* rows[3];
 			for (int j = -1; j <= 1; j++)
 			{
-				for (int i = -1; i <= 1; i++)
-				{
-					int surround_x, surround_y;
-					if (((2 * x + i) < 0) || ((2 * x + i) >= width))
-					{
-						surround_x = 2 * x - i;
-					}
-					else
-					{
-						surround_x = 2 * x + i;
-					}
+				int surround_y = ((2 * y + j) < 0 || (2 * y + j) >= height) ? 2 * y - j : 2 * y + j;
+				rows[j + 1] = planes + (size_t)surround_y * width;
+			}
 
-					if (((2 * y + j) < 0) || ((2 * y + j) >= height))
-					{
-						surround_y = 2 * y - j;
-					}
-					else
-					{
-						surround_y = 2 * y + j;
-					}
+			float* out = newPlanes + (size_t)y * (width / 2);
+			for (int x = 0; x < width / 2; x++)
+			{
+				float sum[3];
+				Half_Sums(rows, 1, planeSize, width, x, sum);
 
-					sum_red += data[(surround_y * width + surround_x) * 4] * matrix[i + 1][j + 1];
-					sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix[i + 1][j + 1];
-					sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix[i + 1][j + 1];
-				}
+				out[x] = sum[0];
+				out[halfSize + x] = sum[1];
+				out[2 * halfSize + x] = sum[2];
+				out[3 * halfSize + x] = 1.0f;
 			}
+		}
+
+		width /= 2;
+		height /= 2;
+		PixelPool::Release((unsigned char*)planes);
+		planes = newPlanes;
+		Mark_Changed();
+		alpha = ALPHA_OPAQUE;
+
+		return true;
+	}// if
 
-			newImage[(y * (width / 2) + x) * 4] = sum_red;
-			newImage[(y * (width / 2) + x) * 4 + 1] = sum_green;
-			newImage[(y * (width / 2) + x) * 4 + 2] = sum_blue;
-			newImage[(y * (width / 2) + x) * 4 + 3] = 255;
+	unsigned char* newImage = PixelPool::Allocate((width / 2) * (height / 2) * 4);
+
+	for (int y = 0; y < height / 2; y++)
+	{
+		const unsigned char* rows[3];
+		for (int j = -1; j <= 1; j++)
+		{
+			int surround_y;
+			if (((2 * y + j) < 0) || ((2 * y + j) >= height))
+			{
+				surround_y = 2 * y - j;
+			}
+			else
+			{
+				surround_y = 2 * y + j;
+			}
+			rows[j + 1] = data + surround_y * width * 4;
 		}
+
+		Half_Row(rows, width, newImage + y * (width / 2) * 4);
 	}
 
 	width /= 2;
 	height /= 2;
-	delete[] data;
+	PixelPool::Release(data);
 	data = newImage;
+	Mark_Changed();
+	alpha = ALPHA_OPAQUE;
 
 	return true;
 }// Half_Size
 
 
-///////////////////////////////////////////////////////////////////////////////
-//
-//      Double the dimensions of this image.  Return success of operation.
-//
-///////////////////////////////////////////////////////////////////////////////
-bool TargaImage::Double_Size()
-{
-	unsigned char* newImage = new unsigned char[(width * 2) * (height * 2) * 4];
-	float matrix_even[3][3] = {
+// Weights Double_Size gives the source pixels around each new one: even
+// rows and columns, odd ones, and a mix of the two.
+static const float matrix_even[3][3] = {
 							{0.0625,0.125,0.0625},
 							{0.125,0.25,0.125},
 							{0.0625,0.125,0.0625}
-	};
+};
 
-	float matrix_odd[4][4] = {
+static const float matrix_odd[4][4] = {
 							{0.015625,0.046875,0.046875,0.015625},
 							{0.046875,0.140625,0.140625,0.046875},
 							{0.046875,0.140625,0.140625,0.046875},
 							{0.015625,0.046875,0.046875,0.015625}
-	};
+};
 
-	float matrix_even_odd[4][3] = {
+static const float matrix_even_odd[4][3] = {
 							{0.03125,0.0625,0.03125},
 							{0.09375,0.18755,0.09375},
 							{0.09375,0.18755,0.09375},
 							{0.03125,0.0625,0.03125}
-	};
+};
+
+// Finds the source pixels pixel (x, y) of the double size version of a
+// width x height image is made from, mirrored at the edges, as indices into
+// the image, with their weights.  They come in the order their products are
+// summed, which the 8 bit and float versions both keep to.  Returns how many.
+static int Double_Taps(int width, int height, int x, int y, int index[16], float weight[16])
+{
+	int across = 3 + x % 2, down = 3 + y % 2;
+	int count = 0;
 
-	for (int y = 0; y < height * 2; y++)
+	for (int j = -1; j < down - 1; j++)
 	{
-		for (int x = 0; x < width * 2; x++)
+		int surround_y = ((y / 2 + j) < 0 || (y / 2 + j) >= height) ? y / 2 - j : y / 2 + j;
+
+		for (int i = -1; i < across - 1; i++)
 		{
-			float sum_red = 0, sum_green = 0, sum_blue = 0;
-			if ((x % 2 == 0) && (y % 2 == 0))
+			int surround_x = ((x / 2 + i) < 0 || (x / 2 + i) >= width) ? x / 2 - i : x / 2 + i;
+
+			index[count] = surround_y * width + surround_x;
+			if (x % 2 == 0 && y % 2 == 0)
+				weight[count] = matrix_even[i + 1][j + 1];
+			else if (x % 2 == 1 && y % 2 == 1)
+				weight[count] = matrix_odd[i + 1][j + 1];
+			else if (x % 2 == 0)
+				weight[count] = matrix_even_odd[j + 1][i + 1];
+			else
+				weight[count] = matrix_even_odd[i + 1][j + 1];
+			count++;
+		}
+	}
+
+	return count;
+}// Double_Taps
+
+
+// Double_Taps' weights for the pixels away from the edges, as one table per
+// case with its taps j by i in the same order.
+struct Double_Weights
+{
+	float w[4][4][4];       // [y % 2 * 2 + x % 2][j + 1][i + 1]
+
+	Double_Weights()
+	{
+		for (int j = 0; j < 4; j++)
+			for (int i = 0; i < 4; i++)
 			{
-				for (int j = -1; j <= 1; j++)
-				{
-					for (int i = -1; i <= 1; i++)
-					{
-						int surround_x, surround_y;
-						if (((x / 2 + i) < 0) || ((x / 2 + i) >= width))
-						{
-							surround_x = (x / 2) - i;
-						}
-						else
-						{
-							surround_x = (x / 2) + i;
-						}
-
-						if (((y / 2 + j) < 0) || ((y / 2 + j) >= height))
-						{
-							surround_y = y / 2 - j;
-						}
-						else
-						{
-							surround_y = y / 2 + j;
-						}
-
-						sum_red += data[(surround_y * width + surround_x) * 4] * matrix_even[i + 1][j + 1];
-						sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix_even[i + 1][j + 1];
-						sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix_even[i + 1][j + 1];
-					}
-				}
+				w[0][j][i] = (i < 3 && j < 3) ? matrix_even[i][j] : 0;
+				w[1][j][i] = j < 3 ? matrix_even_odd[i][j] : 0;
+				w[2][j][i] = i < 3 ? matrix_even_odd[j][i] : 0;
+				w[3][j][i] = matrix_odd[i][j];
 			}
-			else if ((x % 2 == 1) && (y % 2 == 1))
+	}
+};
+static const Double_Weights s_doubleWeights;
+
+
+// Whether the new pixels made from source pixel (sx, sy) have all their taps
+// inside a width x height image, with nothing mirrored.
+static inline bool Double_Interior(int width, int height, int sx, int sy)
+{
+	return sx >= 1 && sy >= 1 && sx + 2 < width && sy + 2 < height;
+}// Double_Interior
+
+
+// Sums up the red, green and blue of pixel (x, y) of the double size version
+// of a width x height image, before they're stored.  Channel c of source
+// pixel n is data[n * step + c * gap], so this works on packed pixels and on
+// planes alike.
+template <class T>
+static inline void Double_Sums(const T* data, int step, size_t gap, int width, int height, int x, int y, float sum[3])
+{
+	sum[0] = sum[1] = sum[2] = 0;
+
+	// Away from the edges nothing mirrors, so Double_Taps' four cases come
+	// down to one loop over a weight table per case, j by i in the same order.
+	int sx = x / 2, sy = y / 2;
+	if (Double_Interior(width, height, sx, sy))
+	{
+		int across = 3 + x % 2, down = 3 + y % 2;
+		const float (*w)[4] = s_doubleWeights.w[y % 2 * 2 + x % 2];
+
+		for (int j = 0; j < down; j++)
+		{
+			const T* row = data + (size_t)((sy + j - 1) * width + sx - 1) * step;
+			for (int i = 0; i < across; i++)
 			{
-				for (int j = -1; j <= 2; j++)
-				{
-					for (int i = -1; i <= 2; i++)
-					{
-						int surround_x, surround_y;
-						if (((x / 2 + i) < 0) || ((x / 2 + i) >= width))
-						{
-							surround_x = (x / 2) - i;
-						}
-						else
-						{
-							surround_x = (x / 2) + i;
-						}
-
-						if (((y / 2 + j) < 0) || ((y / 2 + j) >= height))
-						{
-							surround_y = y / 2 - j;
-						}
-						else
-						{
-							surround_y = y / 2 + j;
-						}
-
-						sum_red += data[(surround_y * width + surround_x) * 4] * matrix_odd[i + 1][j + 1];
-						sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix_odd[i + 1][j + 1];
-						sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix_odd[i + 1][j + 1];
-					}
-				}
+				sum[0] += row[i * step] * w[j][i];
+				sum[1] += row[i * step + gap] * w[j][i];
+				sum[2] += row[i * step + 2 * gap] * w[j][i];
 			}
-			else if ((x % 2 == 0) && (y % 2 == 1))
+		}
+	}
+	else
+	{
+		int index[16];
+		float weight[16];
+		int count = Double_Taps(width, height, x, y, index, weight);
+
+		for (int t = 0; t < count; t++)
+		{
+			sum[0] += data[(size_t)index[t] * step] * weight[t];
+			sum[1] += data[(size_t)index[t] * step + gap] * weight[t];
+			sum[2] += data[(size_t)index[t] * step + 2 * gap] * weight[t];
+		}
+	}
+}// Double_Sums
+
+
+#ifdef TARGA_SSE2
+// The sums for one new pixel from source pixel sx of the rows, red, green, blue
+// and alpha in the lanes.  Each lane multiplies and adds just as Double_Sums
+// does, tap for tap, so the sums come out the same.
+static inline __m128 Double_Sum4(const float* const rows[4], int sx, const float (*w)[4], int across, int down)
+{
+	__m128 sum = _mm_setzero_ps();
+
+	for (int j = 0; j < down; j++)
+	{
+		const float* pixel = rows[j] + (sx - 1) * 4;
+		for (int i = 0; i < across; i++)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pixel + i * 4), _mm_set1_ps(w[j][i])));
+	}
+
+	return sum;
+}// Double_Sum4
+
+
+// Computes the two new pixels in row parity py made from source pixel sx, away
+// from the edges, from the four source rows around it in float.
+static inline void Double_Pair(const float* const rows[4], int sx, int py, unsigned char* out)
+{
+	const __m128i lowByte = _mm_set1_epi32(0xFF);
+	const __m128i alpha = _mm_setr_epi32(0, 0, 0, 255);
+	const float (*even)[4] = s_doubleWeights.w[py * 2];
+	const float (*odd)[4] = s_doubleWeights.w[py * 2 + 1];
+
+	// truncated to int, and then to the low byte, as storing the float sums does
+	__m128i left = _mm_cvttps_epi32(Double_Sum4(rows, sx, even, 3, 3 + py));
+	__m128i right = _mm_cvttps_epi32(Double_Sum4(rows, sx, odd, 4, 3 + py));
+	left = _mm_or_si128(_mm_andnot_si128(alpha, _mm_and_si128(left, lowByte)), alpha);
+	right = _mm_or_si128(_mm_andnot_si128(alpha, _mm_and_si128(right, lowByte)), alpha);
+
+	__m128i packed = _mm_packs_epi32(left, right);
+	_mm_storel_epi64((__m128i*)out, _mm_packus_epi16(packed, packed));
+}// Double_Pair
+#endif
+
+
+// Computes pixel (x, y) of the double size version of a width x height image.
+// Source pixels off the edges are mirrored.
+static inline void Double_Pixel(const unsigned char* data, int width, int height, int x, int y, unsigned char* out)
+{
+	float sum[3];
+
+	Double_Sums(data, 4, 1, width, height, x, y, sum);
+
+	out[0] = sum[0];
+	out[1] = sum[1];
+	out[2] = sum[2];
+	out[3] = 255;
+}// Double_Pixel
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Double the dimensions of this image.  Return success of operation.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool TargaImage::Double_Size()
+{
+	if (Is_Planar())
+	{
+		// the same filter on each plane, kept in float
+		size_t planeSize = (size_t)width * height, doubleSize = planeSize * 4;
+		float* newPlanes = (float*)PixelPool::Allocate(doubleSize * 4 * sizeof(float));
+		TileIterator tiles(width * 2, height * 2);
+
+		#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < tiles.Count(); t++)
+		{
+			ImageTile tile = tiles.Tile(t);
+			for (int y = tile.y; y < tile.y + tile.height; y++)
 			{
-				for (int j = -1; j <= 2; j++)
+				float* out = newPlanes + (size_t)y * (width * 2);
+				for (int x = tile.x; x < tile.x + tile.width; x++)
 				{
-					for (int i = -1; i <= 1; i++)
-					{
-						int surround_x, surround_y;
-						if (((x / 2 + i) < 0) || ((x / 2 + i) >= width))
-						{
-							surround_x = (x / 2) - i;
-						}
-						else
-						{
-							surround_x = (x / 2) + i;
-						}
-
-						if (((y / 2 + j) < 0) || ((y / 2 + j) >= height))
-						{
-							surround_y = y / 2 - j;
-						}
-						else
-						{
-							surround_y = y / 2 + j;
-						}
-
-						sum_red += data[(surround_y * width + surround_x) * 4] * matrix_even_odd[j + 1][i + 1];
-						sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix_even_odd[j + 1][i + 1];
-						sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix_even_odd[j + 1][i + 1];
-					}
+					float sum[3];
+					Double_Sums(planes, 1, planeSize, width, height, x, y, sum);
+
+					out[x] = sum[0];
+					out[doubleSize + x] = sum[1];
+					out[2 * doubleSize + x] = sum[2];
+					out[3 * doubleSize + x] = 1.0f;
 				}
 			}
+		}
+
+		width *= 2;
+		height *= 2;
+		PixelPool::Release((unsigned char*)planes);
+		planes = newPlanes;
+		Mark_Changed();
+		alpha = ALPHA_OPAQUE;
+
+		return true;
+	}// if
+
+	unsigned char* newImage = PixelPool::Allocate((width * 2) * (height * 2) * 4);
+
+	// the two new rows each source row makes share the source rows they read
+	#pragma omp parallel
+	{
+#ifdef TARGA_SSE2
+		vector<float> source((size_t)width * 4 * 4);
+#endif
 
-			else if ((x % 2 == 1) && (y % 2 == 0))
+		#pragma omp for schedule(static)
+		for (int sy = 0; sy < height; sy++)
+		{
+#ifdef TARGA_SSE2
+			const float* rows[4];
+			bool interior = Double_Interior(width, height, 1, sy);
+			if (interior)
 			{
-				for (int j = -1; j <= 1; j++)
+				// the four source rows in float, so each tap is one multiply and add
+				for (int j = 0; j < 4; j++)
 				{
-					for (int i = -1; i <= 2; i++)
-					{
-						int surround_x, surround_y;
-						if (((x / 2 + i) < 0) || ((x / 2 + i) >= width))
-						{
-							surround_x = (x / 2) - i;
-						}
-						else
-						{
-							surround_x = (x / 2) + i;
-						}
-
-						if (((y / 2 + j) < 0) || ((y / 2 + j) >= height))
-						{
-							surround_y = y / 2 - j;
-						}
-						else
-						{
-							surround_y = y / 2 + j;
-						}
-
-						sum_red += data[(surround_y * width + surround_x) * 4] * matrix_even_odd[i + 1][j + 1];
-						sum_green += data[(surround_y * width + surround_x) * 4 + 1] * matrix_even_odd[i + 1][j + 1];
-						sum_blue += data[(surround_y * width + surround_x) * 4 + 2] * matrix_even_odd[i + 1][j + 1];
-					}
+					const unsigned char* in = data + (size_t)(sy + j - 1) * width * 4;
+					float* row = &source[(size_t)j * width * 4];
+					for (int k = 0; k < width * 4; k++)
+						row[k] = in[k];
+					rows[j] = row;
 				}
-			}
-
+			}// if
+#endif
 
+			for (int y = sy * 2; y < sy * 2 + 2; y++)
+			{
+				unsigned char* out = newImage + (size_t)y * (width * 2) * 4;
+				int x = 0;
 
-			newImage[(y * (width * 2) + x) * 4] = sum_red;
-			newImage[(y * (width * 2) + x) * 4 + 1] = sum_green;
-			newImage[(y * (width * 2) + x) * 4 + 2] = sum_blue;
-			newImage[(y * (width * 2) + x) * 4 + 3] = 255;
+#ifdef TARGA_SSE2
+				if (interior)
+				{
+					for (; x < 2; x++)
+						Double_Pixel(data, width, height, x, y, out + x * 4);
+					for (; Double_Interior(width, height, x / 2, sy); x += 2)
+						Double_Pair(rows, x / 2, y % 2, out + x * 4);
+				}// if
+#endif
+
+				for (; x < width * 2; x++)
+					Double_Pixel(data, width, height, x, y, out + x * 4);
+			}
 		}
 	}
 
 	width *= 2;
 	height *= 2;
 
-	delete[] data;
+	PixelPool::Release(data);
 	data = newImage;
+	Mark_Changed();
+	alpha = ALPHA_OPAQUE;
 
 	return true;
 }// Double_Size
@@ -1571,88 +2939,68 @@ bool TargaImage::Rotate(float angleDegrees)
 }// Rotate
 
 
-//////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 //
-//      Given a single RGBA pixel return, via the second argument, the RGB
-//      equivalent composited with a black background.
+//      Clear the image to all black.
 //
 ///////////////////////////////////////////////////////////////////////////////
-void TargaImage::RGBA_To_RGB(unsigned char* rgba, unsigned char* rgb)
+void TargaImage::ClearToBlack()
 {
-	const unsigned char	BACKGROUND[3] = { 0, 0, 0 };
-
-	unsigned char  alpha = rgba[3];
-
-	if (alpha == 0)
-	{
-		rgb[0] = BACKGROUND[0];
-		rgb[1] = BACKGROUND[1];
-		rgb[2] = BACKGROUND[2];
-	}
-	else
-	{
-		float	alpha_scale = (float)255 / (float)alpha;
-		int	val;
-		int	i;
-
-		for (i = 0; i < 3; i++)
-		{
-			val = (int)floor(rgba[i] * alpha_scale);
-			if (val < 0)
-				rgb[i] = 0;
-			else if (val > 255)
-				rgb[i] = 255;
-			else
-				rgb[i] = val;
-		}
-	}
-}// RGA_To_RGB
+	Make_Writable();
+	Mark_Changed();
+	memset(data, 0, width * height * 4);
+	alpha = ALPHA_TRANSLUCENT;
+}// ClearToBlack
 
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-//      Copy this into a new image, reversing the rows as it goes. A pointer
-//  to the new image is returned.
+//      Put a packed block of pixels the size of the view in its place.  Takes
+//  ownership of the block, which must come from PixelPool; a view of the whole
+//  image just swaps it in.  Any smaller view came from View, which marked it
+//  changed already.
 //
 ///////////////////////////////////////////////////////////////////////////////
-TargaImage* TargaImage::Reverse_Rows(void)
+void TargaImage::Replace_View(const ImageView& view, unsigned char* pixels)
 {
-	unsigned char* dest = new unsigned char[width * height * 4];
-	TargaImage* result;
-	int 	        i, j;
-
-	if (!data)
-		return NULL;
-
-	for (i = 0; i < height; i++)
+	if (view.data == data && view.width == width && view.height == height)
 	{
-		int in_offset = (height - i - 1) * width * 4;
-		int out_offset = i * width * 4;
-
-		for (j = 0; j < width; j++)
-		{
-			dest[out_offset + j * 4] = data[in_offset + j * 4];
-			dest[out_offset + j * 4 + 1] = data[in_offset + j * 4 + 1];
-			dest[out_offset + j * 4 + 2] = data[in_offset + j * 4 + 2];
-			dest[out_offset + j * 4 + 3] = data[in_offset + j * 4 + 3];
-		}
-	}
+		PixelPool::Release(data);
+		data = pixels;
+		Mark_Changed();
+		return;
+	}// if
 
-	result = new TargaImage(width, height, dest);
-	delete[] dest;
-	return result;
-}// Reverse_Rows
+	for (int y = 0; y < view.height; y++)
+		memcpy(view.Row(y), pixels + y * view.width * 4, view.width * 4);
+	PixelPool::Release(pixels);
+}// Replace_View
 
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-//      Clear the image to all black.
+//      Run a whole image operation on just the view, by way of a packed copy
+//  of it.  Return success of the operation.
 //
 ///////////////////////////////////////////////////////////////////////////////
-void TargaImage::ClearToBlack()
+bool TargaImage::Run_On_Copy(const ImageView& view, bool (TargaImage::*op)())
 {
-	memset(data, 0, width * height * 4);
-}// ClearToBlack
+	if (view.data == data && view.width == width && view.height == height)
+		return (this->*op)();
+
+	TargaImage region(view.width, view.height);
+	for (int y = 0; y < view.height; y++)
+		memcpy(region.data + y * view.width * 4, view.Row(y), view.width * 4);
+	region.alpha = alpha == ALPHA_OPAQUE ? ALPHA_OPAQUE : ALPHA_UNKNOWN;
+
+	bool bResult = (region.*op)();
+
+	// whatever the operation left behind goes back, as it would for the whole image
+	for (int y = 0; y < view.height; y++)
+		memcpy(view.Row(y), region.data + y * view.width * 4, view.width * 4);
+
+	return bResult;
+}// Run_On_Copy
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1662,6 +3010,10 @@ void TargaImage::ClearToBlack()
 //
 ///////////////////////////////////////////////////////////////////////////////
 void TargaImage::Paint_Stroke(const Stroke& s) {
+	Make_Writable();
+	if (s.a != 255 || alpha != ALPHA_OPAQUE)
+		alpha = ALPHA_UNKNOWN;
+	Mark_Changed((int)s.x - (int)s.radius, (int)s.y - (int)s.radius, 2 * (int)s.radius + 1, 2 * (int)s.radius + 1);
 	int radius_squared = (int)s.radius * (int)s.radius;
 	for (int x_off = -((int)s.radius); x_off <= (int)s.radius; x_off++) {
 		for (int y_off = -((int)s.radius); y_off <= (int)s.radius; y_off++) {
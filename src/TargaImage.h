@@ -18,6 +18,74 @@
 
 class Stroke;
 class DistanceImage;
+struct tga_info;
+
+const int c_tileSize = 64;      // side of the square tiles neighbourhood operations work through
+
+const int c_changeLog = 16;      // rectangles an image remembers changing, see Changes_Since
+
+// A rectangle of an image's pixels.
+struct ImageRect
+{
+    int     x, y;               // top left pixel
+    int     width, height;
+};
+
+// One of the tiles TileIterator splits an image into, c_tileSize a side except
+// along the right and bottom edges.
+typedef ImageRect ImageTile;
+
+// Where an image's changes had got to at some point, from TargaImage::Stamp.
+struct ImageStamp
+{
+    unsigned long long  image;      // which image, never 0
+    unsigned long long  change;     // how many changes it had marked
+};
+
+// A rectangle of some image's pixels, worked on in place.  Doesn't own them.
+struct ImageView
+{
+    unsigned char*  data;       // top left pixel of the rectangle
+    int             width;      // in pixels
+    int             height;     // in pixels
+    int             stride;     // bytes from the start of one row to the next
+
+    unsigned char* Row(int y) const { return data + y * stride; }
+
+    // Copy a tile out packed, with halo extra pixels on every side, (tile.width + 2 * halo) * 4 bytes a row
+    void Read_Tile(const ImageTile& tile, int halo, unsigned char* out) const;
+};
+
+// Splits a width x height area into tiles, left to right and then down.  Walk
+// them with Done/Next/Tile, or by index with Count and Tile(i) for a parallel
+// loop.
+class TileIterator
+{
+    public:
+        TileIterator(int w, int h, int tileSize = c_tileSize)
+            : width(w), height(h), size(tileSize), across((w + tileSize - 1) / tileSize), index(0) {}
+
+        int Count() const { return width > 0 ? across * ((height + size - 1) / size) : 0; }
+        ImageTile Tile(int i) const
+        {
+            ImageTile tile;
+            tile.x = (i % across) * size;
+            tile.y = (i / across) * size;
+            tile.width = width - tile.x < size ? width - tile.x : size;
+            tile.height = height - tile.y < size ? height - tile.y : size;
+            return tile;
+        }
+
+        ImageTile Tile() const { return Tile(index); }
+        bool Done() const { return index >= Count(); }
+        void Next() { ++index; }
+
+    private:
+        int width, height;      // of the area
+        int size;               // of a tile
+        int across;             // tiles in a row
+        int index;              // of the current tile
+};
 
 class TargaImage
 {
@@ -26,25 +94,82 @@ class TargaImage
 	    TargaImage(void);
             TargaImage(int w, int h);
 	    TargaImage(int w, int h, unsigned char *d);
-            TargaImage(const TargaImage& image);
+            TargaImage(const TargaImage& image);    // shares image's pixels until one side changes them
+            TargaImage(TargaImage&& image);         // takes image's pixels, leaving it empty
 	    ~TargaImage(void);
 
+        TargaImage& operator=(const TargaImage& image);
+        TargaImage& operator=(TargaImage&& image);
+
         unsigned char*	To_RGB(void);	            // Convert the image to RGB format,
         bool Save_Image(const char*);               // save the image to a file
-        static TargaImage* Load_Image(char*);       // Load a file and return a pointer to a new TargaImage object.  Returns NULL on failure
-
+        bool Update_Image(const char*, int top, int count); // rewrite just rows top to top + count - 1 of a file Save_Image wrote at this size.  Returns false, leaving any other file alone
+        static TargaImage* Load_Image(char*, int reduce = 1);   // Load a file and return a pointer to a new TargaImage object, optionally at 1/2, 1/4 or 1/8 size.  Returns NULL on failure
+        static bool Probe_Image(const char*, tga_info*);    // Read just a file's header for its size, depth and layout
+
+        typedef bool (TargaImage::*PointOp)(const ImageView&);  // an operation that changes each pixel of a view on its own, like To_Grayscale
+        static bool Stream_Image(const char* inFile, const char* outFile,   // Run point operations from file to file a band of rows at a time,
+                                 const PointOp* ops, const unsigned int* seeds,  // any Dither_Random among them with the seed at the same place
+                                 int numOps, int bandRows = 64);
+
+        void Make_Writable();                       // stop sharing pixels with any copies, before writing to data directly
+
+        // Optional planar float working format.  Gray, dither-fs, dither-color,
+        // the 5x5 filters, half and double work on the planes directly; anything
+        // else packs first.
+        bool Is_Planar() const;
+        void To_Planar();                           // hold the pixels as float planes, with data NULL
+        void To_Packed();                           // back to 8 bit RGBA in data
+        float* Plane(int channel);                  // a plane to write to, unshared
+
+        ImageView View();                           // the whole image, to change
+        ImageView View(int x, int y, int w, int h); // a rectangle of the image to change, clipped to it
+
+        // Change tracking.  Operations mark what they change; anything holding
+        // its own copy of the pixels, like the display or a saved file, takes a
+        // stamp along with it and later asks for just what changed since.
+        void Mark_Changed();                        // the whole image
+        void Mark_Changed(int x, int y, int w, int h);  // a rectangle, clipped to the image
+        ImageStamp Stamp() const;
+        int Changes_Since(const ImageStamp& stamp, ImageRect* rects, int maxRects) const;   // rectangles covering every change since, the whole image if the stamp is from another image or too old
+
+        void To_RGB(unsigned char* rgb, const ImageRect& rect);    // redo just the rectangle of a To_RGB conversion
+
+        // Whether every pixel's alpha is 255.  Then premultiplied and straight
+        // color are the same bytes, and display, saving and diff skip the alpha
+        // math.  Worked out at load and kept up by the operations that change
+        // alpha; only an operation that can't tell leaves it to be looked up.
+        enum EAlpha { ALPHA_UNKNOWN, ALPHA_OPAQUE, ALPHA_TRANSLUCENT };
+        bool Is_Opaque();                           // scans the alpha if it isn't known
+
+        // Operations that take a view change only the pixels it covers, treating
+        // the rectangle as though it were the whole image.
         bool To_Grayscale();
+        bool To_Grayscale(const ImageView& view);
 
         bool Quant_Uniform();
+        bool Quant_Uniform(const ImageView& view);
         bool Quant_Populosity();
+        bool Quant_Populosity(const ImageView& view);
         bool Quant_Median();
 
         bool Dither_Threshold();
+        bool Dither_Threshold(const ImageView& view);
         bool Dither_Random();
+        bool Dither_Random(const ImageView& view);
+        bool Dither_Random(const ImageView& view, unsigned int seed, int left, int top);   // the same noise for a seed every time, keyed on the pixel's place from the view's corner (left, top) on
         bool Dither_FS();
+        bool Dither_FS(const ImageView& view);
         bool Dither_Bright();
+        bool Dither_Bright(const ImageView& view);
         bool Dither_Cluster();
+        bool Dither_Cluster(const ImageView& view);
+        bool Dither_Pattern(const unsigned char* tile, int tileWidth, int tileHeight);
+        bool Dither_Pattern(const ImageView& view, const unsigned char* tile, int tileWidth, int tileHeight);
+        static void Bayer_Tile(int n, unsigned char* tile);     // n by n thresholds for Dither_Pattern, n 2, 4, 8 or 16
+        static void Cluster_Tile(unsigned char* tile);          // Dither_Cluster's 4 by 4 thresholds
         bool Dither_Color();
+        bool Dither_Color(const ImageView& view);
 
         bool Comp_Over(TargaImage* pImage);
         bool Comp_In(TargaImage* pImage);
@@ -55,8 +180,11 @@ class TargaImage
         bool Difference(TargaImage* pImage);
 
         bool Filter_Box();
+        bool Filter_Box(const ImageView& view);
         bool Filter_Bartlett();
+        bool Filter_Bartlett(const ImageView& view);
         bool Filter_Gaussian();
+        bool Filter_Gaussian(const ImageView& view);
         bool Filter_Gaussian_N(unsigned int N);
         bool Filter_Edge();
         bool Filter_Enhance();
@@ -69,11 +197,13 @@ class TargaImage
         bool Rotate(float angleDegrees);
 
     private:
-	// helper function for format conversion
-        void RGBA_To_RGB(unsigned char *rgba, unsigned char *rgb);
-
-        // reverse the rows of the image, some targas are stored bottom to top
-	TargaImage* Reverse_Rows(void);
+        // put a packed block of pixels where the view is, or run an operation on a copy of it
+        void Replace_View(const ImageView& view, unsigned char* pixels);
+        bool Run_On_Copy(const ImageView& view, bool (TargaImage::*op)());
+        ImageView Read_View();                      // the whole image, still shared, for reading only
+        bool Filter_Planes(const float taps[5]);    // a separable 5x5 filter on a planar image
+        void New_Identity();                        // start tracking changes afresh, as a different image
+        void Set_Alpha(const ImageView& view, EAlpha state);   // every pixel in the view now has that kind of alpha
 
 	// clear image to all black
         void ClearToBlack();
@@ -85,8 +215,15 @@ class TargaImage
     public:
         int		width;	    // width of the image in pixels
         int		height;	    // height of the image in pixels
-        unsigned char	*data;	    // pixel data for the image, assumed to be in pre-multiplied RGBA format.
+        unsigned char	*data;	    // pixel data for the image, assumed to be in pre-multiplied RGBA format.  Allocated from PixelPool, and possibly shared with copies of the image -- see Make_Writable.
+        float		*planes;	    // NULL, or red, green, blue and alpha planes of width * height floats each, 0 to 1 and pre-multiplied, and data is NULL.  See To_Planar.
 
+    private:
+        EAlpha              alpha;                  // see Is_Opaque
+        unsigned long long  id;                     // unique to this image, copies included
+        unsigned long long  numChanges;             // marked since the image was made
+        unsigned long long  forgotten;              // changes up to this one were to the whole image or have left the log
+        ImageRect           changed[c_changeLog];   // the latest rectangles marked, change n in changed[n % c_changeLog]
 };
 
 class Stroke { // Data structure for holding painterly strokes.
@@ -2,8 +2,31 @@
 ** libtarga.c -- routines for reading targa files.
 */
 
+// band writers seek around files that can be bigger than 2GB.
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include <stdio.h>
+#include <stddef.h>
 #include <malloc.h>
+#include <string.h>
+#include <math.h>
+
+// platform headers go first -- libtarga.h #defines 'byte'.
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TGA_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 #include "libtarga.h"
 
@@ -18,10 +41,9 @@
 #define TGA_IMG_RLE_GRAYSCALE      (11)
 
 
-#define TGA_LOWER_LEFT             (0)
-#define TGA_LOWER_RIGHT            (1)
-#define TGA_UPPER_LEFT             (2)
-#define TGA_UPPER_RIGHT            (3)
+#define TGA_PACKET_RAW             (0)
+#define TGA_PACKET_RUN             (1)
+#define TGA_PACKET_ZERO            (2)      // a run packet the file ends before the pixel of.
 
 
 #define HDR_LENGTH               (18)
@@ -38,6 +60,8 @@
 #define HDR_IMG_SPEC_PIX_DEPTH   (16)
 #define HDR_IMG_SPEC_IMG_DESC    (17)
 
+#define TGA_HEADER_BYTES         (HDR_LENGTH + 21)  // header plus our image id.
+
 
 #define TGA_ERR_NONE                    (0)
 #define TGA_ERR_BAD_HEADER              (1)
@@ -51,6 +75,19 @@
 #define TGA_ERR_READ_FAILS              (9)
 #define TGA_ERR_BAD_IMAGE_TYPE          (10)
 #define TGA_ERR_BAD_DIMENSIONS          (11)
+#define TGA_ERR_WRITE_FAILS             (12)
+#define TGA_ERR_MEM                     (13)
+
+
+#ifdef _WIN32
+#define tga_fseek   _fseeki64
+#define tga_ftell   _ftelli64
+typedef __int64     tga_off;
+#else
+#define tga_fseek   fseeko
+#define tga_ftell   ftello
+typedef off_t       tga_off;
+#endif
 
 
 static uint32 TargaError;
@@ -59,14 +96,105 @@ static uint32 TargaError;
 static int16 ttohs( int16 val );
 static int16 htots( int16 val );
 static int32 ttohl( int32 val );
-static int32 htotl( int32 val );
 
 
-static uint32 tga_get_pixel( FILE * tga, ubyte bytes_per_pix, 
-                            ubyte * colormap, ubyte cmap_bytes_entry );
+/* everything needed to turn encoded image data units into output pixels */
+typedef struct {
+    uint32  width;
+    uint32  height;
+    ubyte   bytes_per_pix;      // size of one data unit (index or BGR(A) value) in the file.
+    ubyte   true_bits;          // bits per pixel after any colormap lookup.
+    ubyte   alphabits;
+    ubyte   img_desc;           // image descriptor, for the origin bits.
+    uint32  format;             // TGA_TRUECOLOR_24 or TGA_TRUECOLOR_32.
+    ubyte * colormap;
+    ubyte   cmap_bytes_entry;
+    uint32  cmap_length;
+    uint32 * lut;               // converted pixel for every data unit value, for 1 and 2 byte units.
+    uint32  zero;               // converted pixel for a data unit that couldn't be read.
+} tga_decoder;
+
+
+/* a file's contents, mapped into memory where the platform allows it */
+typedef struct {
+    const ubyte * base;
+    size_t  len;
+    int     mapped;             // 0 if base was malloc'd and read in instead.
+} tga_file_map;
+
+
+/* where the packet stream of a run-length encoded file stands as one row begins */
+typedef struct {
+    size_t  pos;                // next byte of the payload to read.
+    size_t  value;              // where the pixel of the current run packet sits.
+    uint32  left;               // pixels still to come from the current packet, 0 between packets.
+    ubyte   kind;               // one of the TGA_PACKET constants above.
+} tga_rle_state;
+
+
+/* an open targa -- header details plus where its pixel data sits in the mapped file */
+struct tga_reader {
+    tga_file_map  map;
+    uint32  width;
+    uint32  height;
+    ubyte   image_type;
+    ubyte   bytes_per_pix;
+    ubyte   true_bits;
+    ubyte   alphabits;
+    ubyte   img_desc;
+    ubyte * colormap;
+    ubyte   cmap_bytes_entry;
+    uint32  cmap_length;
+    const ubyte * payload;
+    size_t  payload_len;
+    tga_decoder dec;            // decoder for the format last asked for.
+    tga_rle_state * rle_rows;   // stream state at the start of each row in file order, for RLE files.
+};
+
+
+/* a targa being written a band at a time */
+struct tga_writer {
+    FILE *  fp;
+    uint32  width;
+    uint32  height;
+    uint32  format;
+    ubyte * band;               // converted rows, in file order, for the band being written.
+    size_t  band_rows;          // rows 'band' has room for.
+    int     opaque;             // rows come with every alpha at 255, so need no un-premultiplying.
+    int     failed;             // set once any write goes wrong.
+};
+
+
+/* premultiplied value of each (alpha, color) pair, exactly as tga_convert_color computes it */
+static ubyte tga_premult[256][256];
+static int   tga_tables_ready = 0;
+
+static void tga_init_tables( void );
+static size_t tga_build_header( ubyte * hdr, int width, int height, unsigned int format, ubyte img_type );
+static void tga_convert_row_out( ubyte * dst, const ubyte * src, int width, unsigned int format );
+static void tga_swizzle( ubyte * dst, const ubyte * src, int count );
+static size_t tga_rle_encode_row( ubyte * out, const ubyte * row, int width, unsigned int format );
+static int  tga_write_encoded( const char * file, int width, int height, unsigned char * dat, 
+                              unsigned int format, int rle );
+static int  tga_map_file( const char * filename, tga_file_map * map );
+static void tga_unmap_file( tga_file_map * map );
+static const tga_decoder * tga_reader_decoder( tga_reader * tga, uint32 format );
+static int  tga_decode_rows( tga_reader * tga, const tga_decoder * dec, uint32 row, uint32 count, 
+                            ubyte * dat, ptrdiff_t stride );
+static int  tga_rle_prescan( tga_reader * tga );
+static void tga_rle_walk( const tga_reader * tga, const tga_decoder * dec, tga_rle_state * st, 
+                         uint32 count, ubyte * dst, int step );
+
 static uint32 tga_convert_color( uint32 pixel, uint32 bpp_in, ubyte alphabits, uint32 format_out );
-static void tga_write_pixel_to_mem( ubyte * dat, ubyte img_spec, uint32 number, 
-                                   uint32 w, uint32 h, uint32 pixel, uint32 format );
+
+static void tga_decoder_init( tga_decoder * dec, uint32 w, uint32 h, ubyte bytes_per_pix, ubyte true_bits,
+                             ubyte alphabits, ubyte img_desc, uint32 format, 
+                             ubyte * colormap, ubyte cmap_bytes_entry, uint32 cmap_length );
+static void tga_decoder_free( tga_decoder * dec );
+static uint32 tga_decode_pixel( const tga_decoder * dec, const ubyte * src );
+static void tga_decode_span( const tga_decoder * dec, const ubyte * src, uint32 count, 
+                            ubyte * dst, int step );
+static void tga_fill_span( const tga_decoder * dec, uint32 pixel, uint32 count, ubyte * dst, int step );
 
 
 /* returns the last error encountered */
@@ -116,6 +244,12 @@ const char * tga_error_string( int error_code ) {
     case TGA_ERR_BAD_DIMENSIONS:
         return( "image has size 0 width or height (or both)" );
 
+    case TGA_ERR_WRITE_FAILS:
+        return( "cannot write to file" );
+
+    case TGA_ERR_MEM:
+        return( "out of memory" );
+
     default:
         return( "unknown error" );
 
@@ -152,6 +286,164 @@ void * tga_create( int width, int height, unsigned int format ) {
 /* loads and converts a targa from disk */
 void * tga_load( const char * filename, 
                 int * width, int * height, unsigned int format ) {
+
+    tga_reader * tga;
+    const tga_decoder * dec;
+
+    ubyte * image_data;
+
+    uint32 bytes_total;
+    size_t row_bytes;
+
+
+    switch( format ) {
+
+    case TGA_TRUECOLOR_24:
+    case TGA_TRUECOLOR_32:
+        break;
+
+    default:
+        TargaError = TGA_ERR_BAD_FORMAT;
+        return( NULL );
+
+    }
+
+    tga = tga_open( filename, width, height );
+    if( tga == NULL ) {
+        return( NULL );
+    }
+
+    /* compute how many bytes of storage we need for the image */
+    bytes_total = tga->width * tga->height * format;
+
+    image_data = (ubyte *)malloc( bytes_total );
+    if( image_data == NULL ) {
+        tga_close( tga );
+        TargaError = TGA_ERR_MEM;
+        return( NULL );
+    }
+
+    dec = tga_reader_decoder( tga, format );
+
+    /* FIXME: support grayscale */
+
+    // rows come out top first, so start at the top of our lower-left image and work down.
+    row_bytes = (size_t)tga->width * format;
+    if( !tga_decode_rows( tga, dec, 0, tga->height, 
+        image_data + (tga->height - 1) * row_bytes, -(ptrdiff_t)row_bytes ) ) {
+        free( image_data );
+        tga_close( tga );
+        return( NULL );
+    }
+
+    tga_close( tga );
+
+    return( (void *)image_data );
+
+}
+
+
+
+
+/* reads just the header of a targa, for its size and layout */
+int tga_probe( const char * filename, tga_info * info ) {
+
+    FILE * fp;
+    ubyte  tga_hdr[HDR_LENGTH];
+
+    ubyte  cmap_type;
+    ubyte  image_type;
+    ubyte  cmap_entry_size;
+    ubyte  pix_depth;
+    ubyte  img_desc;
+
+
+    fp = fopen( filename, "rb" );
+    if( fp == NULL ) {
+        TargaError = TGA_ERR_OPEN_FAILS;
+        return( 0 );
+    }
+
+    if( fread( tga_hdr, 1, HDR_LENGTH, fp ) != HDR_LENGTH ) {
+        fclose( fp );
+        TargaError = TGA_ERR_BAD_HEADER;
+        return( 0 );
+    }
+
+    fclose( fp );
+
+    image_type      = tga_hdr[HDR_IMAGE_TYPE];
+    cmap_type       = tga_hdr[HDR_CMAP_TYPE];
+    cmap_entry_size = tga_hdr[HDR_CMAP_ENTRY_SIZE];
+    pix_depth       = tga_hdr[HDR_IMG_SPEC_PIX_DEPTH];
+    img_desc        = tga_hdr[HDR_IMG_SPEC_IMG_DESC];
+
+    info->width           = tga_hdr[HDR_IMG_SPEC_WIDTH] | (tga_hdr[HDR_IMG_SPEC_WIDTH + 1] << 8);
+    info->height          = tga_hdr[HDR_IMG_SPEC_HEIGHT] | (tga_hdr[HDR_IMG_SPEC_HEIGHT + 1] << 8);
+    info->depth           = pix_depth;
+    info->true_bits       = cmap_type ? cmap_entry_size : pix_depth;
+    info->alphabits       = img_desc & 0x0F;
+    info->image_type      = image_type;
+    info->rle             = image_type == TGA_IMG_RLE_PALETTED || 
+                            image_type == TGA_IMG_RLE_TRUECOLOR || 
+                            image_type == TGA_IMG_RLE_GRAYSCALE;
+    info->cmap_length     = cmap_type ? tga_hdr[HDR_CMAP_LENGTH] | (tga_hdr[HDR_CMAP_LENGTH + 1] << 8) : 0;
+    info->cmap_entry_size = cmap_type ? cmap_entry_size : 0;
+    info->origin          = (img_desc & 0x30) >> 4;
+
+    /* the same checks tga_open makes, short of reading the colormap and pixels */
+    if( info->width * info->height == 0 ) {
+        TargaError = TGA_ERR_BAD_DIMENSIONS;
+        return( 0 );
+    }
+
+    if( image_type == TGA_IMG_NODATA ) {
+        TargaError = TGA_ERR_NODATA_IMAGE;
+        return( 0 );
+    }
+
+    if( cmap_type ) {
+
+        if( image_type == TGA_IMG_UNC_GRAYSCALE || image_type == TGA_IMG_RLE_GRAYSCALE ) {
+            TargaError = TGA_ERR_COLORMAP_FOR_GRAY;
+            return( 0 );
+        }
+
+        if( !(cmap_entry_size == 15 || 
+            cmap_entry_size == 16 ||
+            cmap_entry_size == 24 ||
+            cmap_entry_size == 32) ) {
+            TargaError = TGA_ERR_BAD_COLORMAP_ENTRY_SIZE;
+            return( 0 );
+        }
+
+    }
+
+    switch( image_type ) {
+
+    case TGA_IMG_UNC_TRUECOLOR:
+    case TGA_IMG_UNC_GRAYSCALE:
+    case TGA_IMG_UNC_PALETTED:
+    case TGA_IMG_RLE_TRUECOLOR:
+    case TGA_IMG_RLE_GRAYSCALE:
+    case TGA_IMG_RLE_PALETTED:
+        break;
+
+    default:
+        TargaError = TGA_ERR_BAD_IMAGE_TYPE;
+        return( 0 );
+
+    }
+
+    return( 1 );
+
+}
+
+
+
+
+/* opens a targa for reading and checks its header */
+tga_reader * tga_open( const char * filename, int * width, int * height ) {
     
     ubyte  idlen;               // length of the image_id string below.
     ubyte  cmap_type;           // paletted image <=> cmap_type
@@ -159,77 +451,47 @@ void * tga_load( const char * filename,
     uint16 cmap_first;          // 
     uint16 cmap_length;         // how long the colormap is
     ubyte  cmap_entry_size;     // how big a palette entry is.
-    uint16 img_spec_xorig;      // the x origin of the image in the image data.
-    uint16 img_spec_yorig;      // the y origin of the image in the image data.
     uint16 img_spec_width;      // the width of the image.
     uint16 img_spec_height;     // the height of the image.
     ubyte  img_spec_pix_depth;  // the depth of a pixel in the image.
     ubyte  img_spec_img_desc;   // the image descriptor.
 
-    FILE * targafile;
-
-    ubyte * tga_hdr = NULL;
+    tga_reader * tga;
 
-    ubyte * colormap = NULL;
+    const ubyte * tga_hdr;
 
     ubyte cmap_bytes_entry = 0; // Prevents spurious debug runtime check in VC2003
-    uint32 cmap_bytes;
     
-    uint32 tmp_col;
     uint32 tmp_int32;
-    ubyte  tmp_byte;
 
-    ubyte alphabits = 0;
+    size_t pos;
 
-    uint32 num_pixels;
-    
     uint32 i;
     uint32 j;
 
-    ubyte * image_data;
-    uint32 img_dat_len;
-
     ubyte bytes_per_pix;
 
-    ubyte true_bits_per_pixel;
-
-    uint32 bytes_total = 0;
-
-    ubyte packet_header;
-    ubyte repcount;
-    
-
-    switch( format ) {
-
-    case TGA_TRUECOLOR_24:
-    case TGA_TRUECOLOR_32:
-        break;
 
-    default:
-        TargaError = TGA_ERR_BAD_FORMAT;
+    tga = (tga_reader *)calloc( 1, sizeof( tga_reader ) );
+    if( tga == NULL ) {
+        TargaError = TGA_ERR_MEM;
         return( NULL );
-
     }
 
-    
-    /* open binary image file */
-    targafile = fopen( filename, "rb" );
-    if( targafile == NULL ) {
-        TargaError = TGA_ERR_OPEN_FAILS;
+    /* map the file, so the pixels are only ever touched once on their way into memory */
+    if( !tga_map_file( filename, &tga->map ) ) {
+        free( tga );
         return( NULL );
     }
 
-
-    /* allocate memory for the header */
-    tga_hdr = (ubyte *)malloc( HDR_LENGTH );
-
-    /* read the header in. */
-    if( fread( (void *)tga_hdr, 1, HDR_LENGTH, targafile ) != HDR_LENGTH ) {
-        free( tga_hdr );
+    if( tga->map.len < HDR_LENGTH ) {
+        tga_close( tga );
         TargaError = TGA_ERR_BAD_HEADER;
         return( NULL );
     }
 
+    tga_hdr = tga->map.base;
+
     
     /* byte order is important here. */
     idlen              = (ubyte)tga_hdr[HDR_IDLEN];
@@ -237,42 +499,35 @@ void * tga_load( const char * filename,
     image_type         = (ubyte)tga_hdr[HDR_IMAGE_TYPE];
     
     cmap_type          = (ubyte)tga_hdr[HDR_CMAP_TYPE];
-    cmap_first         = ttohs( *(uint16 *)(&tga_hdr[HDR_CMAP_FIRST]) );
-    cmap_length        = ttohs( *(uint16 *)(&tga_hdr[HDR_CMAP_LENGTH]) );
+    cmap_first         = tga_hdr[HDR_CMAP_FIRST] | (tga_hdr[HDR_CMAP_FIRST + 1] << 8);
+    cmap_length        = tga_hdr[HDR_CMAP_LENGTH] | (tga_hdr[HDR_CMAP_LENGTH + 1] << 8);
     cmap_entry_size    = (ubyte)tga_hdr[HDR_CMAP_ENTRY_SIZE];
 
-    img_spec_xorig     = ttohs( *(uint16 *)(&tga_hdr[HDR_IMG_SPEC_XORIGIN]) );
-    img_spec_yorig     = ttohs( *(uint16 *)(&tga_hdr[HDR_IMG_SPEC_YORIGIN]) );
-    img_spec_width     = ttohs( *(uint16 *)(&tga_hdr[HDR_IMG_SPEC_WIDTH]) );
-    img_spec_height    = ttohs( *(uint16 *)(&tga_hdr[HDR_IMG_SPEC_HEIGHT]) );
+    img_spec_width     = tga_hdr[HDR_IMG_SPEC_WIDTH] | (tga_hdr[HDR_IMG_SPEC_WIDTH + 1] << 8);
+    img_spec_height    = tga_hdr[HDR_IMG_SPEC_HEIGHT] | (tga_hdr[HDR_IMG_SPEC_HEIGHT + 1] << 8);
     img_spec_pix_depth = (ubyte)tga_hdr[HDR_IMG_SPEC_PIX_DEPTH];
     img_spec_img_desc  = (ubyte)tga_hdr[HDR_IMG_SPEC_IMG_DESC];
 
-    free( tga_hdr );
-
+    pos = HDR_LENGTH;
 
-    num_pixels = img_spec_width * img_spec_height;
 
-    if( num_pixels == 0 ) {
+    if( img_spec_width * img_spec_height == 0 ) {
+        tga_close( tga );
         TargaError = TGA_ERR_BAD_DIMENSIONS;
         return( NULL );
     }
 
     
-    alphabits = img_spec_img_desc & 0x0F;
-
-    
-    /* seek past the image id, if there is one */
-    if( idlen ) {
-        if( fseek( targafile, idlen, SEEK_CUR ) ) {
-            TargaError = TGA_ERR_UNEXPECTED_EOF;
-            return( NULL );
-        }
+    /* skip the image id, if there is one */
+    pos += idlen;
+    if( pos > tga->map.len ) {
+        pos = tga->map.len;
     }
 
 
     /* if this is a 'nodata' image, just jump out. */
     if( image_type == TGA_IMG_NODATA ) {
+        tga_close( tga );
         TargaError = TGA_ERR_NODATA_IMAGE;
         return( NULL );
     }
@@ -299,6 +554,7 @@ void * tga_load( const char * filename,
             
         case TGA_IMG_UNC_GRAYSCALE:
         case TGA_IMG_RLE_GRAYSCALE:
+            tga_close( tga );
             TargaError = TGA_ERR_COLORMAP_FOR_GRAY;
             return( NULL );
         }
@@ -308,6 +564,7 @@ void * tga_load( const char * filename,
             cmap_entry_size == 16 ||
             cmap_entry_size == 24 ||
             cmap_entry_size == 32) ) {
+            tga_close( tga );
             TargaError = TGA_ERR_BAD_COLORMAP_ENTRY_SIZE;
             return( NULL );
         }
@@ -320,32 +577,35 @@ void * tga_load( const char * filename,
             cmap_bytes_entry = (cmap_entry_size >> 3);
         }
         
-        cmap_bytes = cmap_bytes_entry * cmap_length;
-        colormap = (ubyte *)malloc( cmap_bytes );
+        tga->colormap = (ubyte *)malloc( cmap_bytes_entry * cmap_length + 1 );
+        if( tga->colormap == NULL ) {
+            tga_close( tga );
+            TargaError = TGA_ERR_MEM;
+            return( NULL );
+        }
         
         
         for( i = 0; i < cmap_length; i++ ) {
             
             /* seek ahead to first entry used */
-            if( cmap_first != 0 ) {
-                fseek( targafile, cmap_first * cmap_bytes_entry, SEEK_CUR );
+            pos += cmap_first * cmap_bytes_entry;
+
+            if( pos + cmap_bytes_entry > tga->map.len ) {
+                tga_close( tga );
+                TargaError = TGA_ERR_BAD_COLORMAP;
+                return( NULL );
             }
             
             tmp_int32 = 0;
             for( j = 0; j < cmap_bytes_entry; j++ ) {
-                if( !fread( &tmp_byte, 1, 1, targafile ) ) {
-                    free( colormap );
-                    TargaError = TGA_ERR_BAD_COLORMAP;
-                    return( NULL );
-                }
-                tmp_int32 += tmp_byte << (j * 8);
+                tmp_int32 += tga_hdr[pos++] << (j * 8);
             }
 
             // byte order correct.
             tmp_int32 = ttohl( tmp_int32 );
 
             for( j = 0; j < cmap_bytes_entry; j++ ) {
-                colormap[i * cmap_bytes_entry + j] = (tmp_int32 >> (8 * j)) & 0xFF;
+                tga->colormap[i * cmap_bytes_entry + j] = (tmp_int32 >> (8 * j)) & 0xFF;
             }
             
         }
@@ -367,244 +627,124 @@ void * tga_load( const char * filename,
     }
 
 
-    /* compute how many bytes of storage we need for the image */
-    bytes_total = img_spec_width * img_spec_height * format;
-
-    image_data = (ubyte *)malloc( bytes_total );
-
-    img_dat_len = img_spec_width * img_spec_height * bytes_per_pix;
-
-    // compute the true number of bits per pixel
-    true_bits_per_pixel = cmap_type ? cmap_entry_size : img_spec_pix_depth;
-
     switch( image_type ) {
 
     case TGA_IMG_UNC_TRUECOLOR:
     case TGA_IMG_UNC_GRAYSCALE:
     case TGA_IMG_UNC_PALETTED:
-
-        /* FIXME: support grayscale */
-
-        for( i = 0; i < num_pixels; i++ ) {
-
-            // get the color value.
-            tmp_col = tga_get_pixel( targafile, bytes_per_pix, colormap, cmap_bytes_entry );
-            tmp_col = tga_convert_color( tmp_col, true_bits_per_pixel, alphabits, format );
-            
-            // now write the data out.
-            tga_write_pixel_to_mem( image_data, img_spec_img_desc, 
-                i, img_spec_width, img_spec_height, tmp_col, format );
-
-        }
-    
-        break;
-
-
     case TGA_IMG_RLE_TRUECOLOR:
     case TGA_IMG_RLE_GRAYSCALE:
     case TGA_IMG_RLE_PALETTED:
-
-        // FIXME: handle grayscale..
-
-        for( i = 0; i < num_pixels; ) {
-
-            /* a bit of work to do to read the data.. */
-            if( fread( &packet_header, 1, 1, targafile ) < 1 ) {
-                // well, just let them fill the rest with null pixels then...
-                packet_header = 1;
-            }
-
-            if( packet_header & 0x80 ) {
-                /* run length packet */
-
-                tmp_col = tga_get_pixel( targafile, bytes_per_pix, colormap, cmap_bytes_entry );
-                tmp_col = tga_convert_color( tmp_col, true_bits_per_pixel, alphabits, format );
-                
-                repcount = (packet_header & 0x7F) + 1;
-                
-                /* write all the data out */
-                for( j = 0; j < repcount; j++ ) {
-                    tga_write_pixel_to_mem( image_data, img_spec_img_desc, 
-                        i + j, img_spec_width, img_spec_height, tmp_col, format );
-                }
-
-                i += repcount;
-
-            } else {
-                /* raw packet */
-                /* get pixel from file */
-                
-                repcount = (packet_header & 0x7F) + 1;
-                
-                for( j = 0; j < repcount; j++ ) {
-                    
-                    tmp_col = tga_get_pixel( targafile, bytes_per_pix, colormap, cmap_bytes_entry );
-                    tmp_col = tga_convert_color( tmp_col, true_bits_per_pixel, alphabits, format );
-                    
-                    tga_write_pixel_to_mem( image_data, img_spec_img_desc, 
-                        i + j, img_spec_width, img_spec_height, tmp_col, format );
-
-                }
-
-                i += repcount;
-
-            }
-
-        }
-
         break;
-    
 
     default:
-
+        tga_close( tga );
         TargaError = TGA_ERR_BAD_IMAGE_TYPE;
         return( NULL );
 
     }
 
-    fclose( targafile );
+
+    tga->width            = img_spec_width;
+    tga->height           = img_spec_height;
+    tga->image_type       = image_type;
+    tga->bytes_per_pix    = bytes_per_pix;
+    // compute the true number of bits per pixel
+    tga->true_bits        = cmap_type ? cmap_entry_size : img_spec_pix_depth;
+    tga->alphabits        = img_spec_img_desc & 0x0F;
+    tga->img_desc         = img_spec_img_desc;
+    tga->cmap_bytes_entry = cmap_bytes_entry;
+    tga->cmap_length      = cmap_type ? cmap_length : 0;
+
+    /* whatever follows is pixel data -- packets for RLE images run to the end of the file */
+    tga->payload          = tga->map.base + pos;
+    tga->payload_len      = tga->map.len - pos;
 
     *width  = img_spec_width;
     *height = img_spec_height;
 
-    return( (void *)image_data );
+    return( tga );
 
 }
 
 
 
 
-int tga_write_raw( const char * file, int width, int height, unsigned char * dat, unsigned int format ) {
-
-    FILE * tga;
-
-    uint32 i, j;
-
-    uint32 size = width * height;
+/* decodes rows [row, row + count) of the image, counting down from the top row, into dat */
+int tga_read_rows( tga_reader * tga, int row, int count, unsigned char * dat, unsigned int format ) {
 
-    float red, green, blue, alpha;
+    const tga_decoder * dec;
 
-    char id[] = "written with libtarga";
-    ubyte idlen = 21;
-    ubyte zeroes[5] = { 0, 0, 0, 0, 0 };
-    uint32 pixbuf;
-    ubyte one = 1;
-    ubyte cmap_type = 0;
-    ubyte img_type  = 2;  // 2 - uncompressed truecolor  10 - RLE truecolor
-    uint16 xorigin  = 0;
-    uint16 yorigin  = 0;
-    ubyte  pixdepth = format * 8;  // bpp
-    ubyte img_desc;
-    
-    
     switch( format ) {
 
     case TGA_TRUECOLOR_24:
-        img_desc = 0;
-        break;
-
     case TGA_TRUECOLOR_32:
-        img_desc = 8;
         break;
 
     default:
         TargaError = TGA_ERR_BAD_FORMAT;
         return( 0 );
-        break;
 
     }
 
-    tga = fopen( file, "wb" );
-
-    if( tga == NULL ) {
-        TargaError = TGA_ERR_OPEN_FAILS;
+    if( row < 0 || count < 0 || (uint32)(row + count) > tga->height ) {
+        TargaError = TGA_ERR_BAD_DIMENSIONS;
         return( 0 );
     }
 
-    // write id length
-    fwrite( &idlen, 1, 1, tga );
+    dec = tga_reader_decoder( tga, format );
 
-    // write colormap type
-    fwrite( &cmap_type, 1, 1, tga );
+    return( tga_decode_rows( tga, dec, row, count, dat, (ptrdiff_t)tga->width * format ) );
 
-    // write image type
-    fwrite( &img_type, 1, 1, tga );
-
-    // write cmap spec.
-    fwrite( &zeroes, 5, 1, tga );
+}
 
-    // write image spec.
-    fwrite( &xorigin, 2, 1, tga );
-    fwrite( &yorigin, 2, 1, tga );
-    fwrite( &width, 2, 1, tga );
-    fwrite( &height, 2, 1, tga );
-    fwrite( &pixdepth, 1, 1, tga );
-    fwrite( &img_desc, 1, 1, tga );
 
 
-    // write image id.
-    fwrite( &id, idlen, 1, tga );
 
-    // color correction -- data is in RGB, need BGR.
-    for( i = 0; i < size; i++ ) {
+/* returns 1 if the header alone shows every pixel will come out with full alpha */
+int tga_opaque( const tga_reader * tga ) {
 
-        pixbuf = 0;
-        for( j = 0; j < format; j++ ) {
-            pixbuf += dat[i*format+j] << (8 * j);
-        }
+    switch( tga->true_bits ) {
 
-        switch( format ) {
+    case 15:
+    case 16:
+    case 24:
+        return( 1 );
 
-        case TGA_TRUECOLOR_24:
+    case 32:
+        return( tga->alphabits == 0 );
 
-            pixbuf = ((pixbuf & 0xFF) << 16) + 
-                     (pixbuf & 0xFF00) + 
-                     ((pixbuf & 0xFF0000) >> 16);
+    default:
+        return( 0 );
 
-            pixbuf = htotl( pixbuf );
-            
-            fwrite( &pixbuf, 3, 1, tga );
+    }
 
-            break;
+}
 
-        case TGA_TRUECOLOR_32:
 
-            /* need to un-premultiply alpha.. */
 
-            red     = (pixbuf & 0xFF) / 255.0f;
-            green   = ((pixbuf & 0xFF00) >> 8) / 255.0f;
-            blue    = ((pixbuf & 0xFF0000) >> 16) / 255.0f;
-            alpha   = ((pixbuf & 0xFF000000) >> 24) / 255.0f;
 
-            if( alpha > 0.0001 ) {
-                red /= alpha;
-                green /= alpha;
-                blue /= alpha;
-            }
+/* releases everything held by an open targa */
+void tga_close( tga_reader * tga ) {
 
-            /* clamp to 1.0f */
+    if( tga == NULL ) {
+        return;
+    }
 
-            red = red > 1.0f ? 255.0f : red * 255.0f;
-            green = green > 1.0f ? 255.0f : green * 255.0f;
-            blue = blue > 1.0f ? 255.0f : blue * 255.0f;
-            alpha = alpha > 1.0f ? 255.0f : alpha * 255.0f;
+    tga_decoder_free( &tga->dec );
+    tga_unmap_file( &tga->map );
+    free( tga->colormap );
+    free( tga->rle_rows );
+    free( tga );
 
-            pixbuf = (ubyte)blue + (((ubyte)green) << 8) + 
-                (((ubyte)red) << 16) + (((ubyte)alpha) << 24);
-                
-            pixbuf = htotl( pixbuf );
-           
-            fwrite( &pixbuf, 4, 1, tga );
+}
 
-            break;
 
-        }
 
-    }
 
-    fclose( tga );
+int tga_write_raw( const char * file, int width, int height, unsigned char * dat, unsigned int format ) {
 
-    return( 1 );
+    return( tga_write_encoded( file, width, height, dat, format, 0 ) );
 
 }
 
@@ -613,41 +753,41 @@ int tga_write_raw( const char * file, int width, int height, unsigned char * dat
 
 int tga_write_rle( const char * file, int width, int height, unsigned char * dat, unsigned int format ) {
 
-    FILE * tga;
+    return( tga_write_encoded( file, width, height, dat, format, 1 ) );
+
+}
 
-    uint32 i, j;
-    uint32 oc, nc;
 
-    enum RLE_STATE { INIT, NONE, RLP, RAWP };
 
-    int state = INIT;
 
-    uint32 size = width * height;
+/* the most bytes tga_encode_to_buffer can produce for an image */
+size_t tga_encoded_size_max( int width, int height, unsigned int format, int rle ) {
+
+    // rle rows are at worst all raw packets, one header byte per 128 pixels.
+    size_t row_max = (size_t)width * format + (rle ? (width + 127) / 128 : 0);
+
+    return( TGA_HEADER_BYTES + row_max * height );
+
+}
 
-    uint16 shortwidth = (uint16)width;
-    uint16 shortheight = (uint16)height;
 
-    ubyte repcount;
 
-    float red, green, blue, alpha;
 
-    int idx, row, column;
+/* encodes a whole targa file into memory -- into buf if it's given, otherwise a buffer we allocate */
+unsigned char * tga_encode_to_buffer( int width, int height, unsigned char * dat, unsigned int format, 
+                                     int rle, unsigned char * buf, size_t * len ) {
 
-    // have to buffer a whole line for raw packets.
-    unsigned char * rawbuf = (unsigned char *)malloc( width * format );  
+    int row;
+
+    size_t row_max;             // worst case size of one encoded row.
+    size_t * row_len;
+    size_t total;
+
+    ubyte * out;
+    ubyte * scratch;
+
+    int failed = 0;
 
-    char id[] = "written with libtarga";
-    ubyte idlen = 21;
-    ubyte zeroes[5] = { 0, 0, 0, 0, 0 };
-    uint32 pixbuf;
-    ubyte one = 1;
-    ubyte cmap_type = 0;
-    ubyte img_type  = 10;  // 2 - uncompressed truecolor  10 - RLE truecolor
-    uint16 xorigin  = 0;
-    uint16 yorigin  = 0;
-    ubyte  pixdepth = format * 8;  // bpp
-    ubyte img_desc  = format == TGA_TRUECOLOR_32 ? 8 : 0;
-  
 
     switch( format ) {
     case TGA_TRUECOLOR_24:
@@ -656,386 +796,911 @@ int tga_write_rle( const char * file, int width, int height, unsigned char * dat
 
     default:
         TargaError = TGA_ERR_BAD_FORMAT;
-        return( 0 );
+        return( NULL );
     }
 
+    if( width < 0 || height < 0 ) {
+        TargaError = TGA_ERR_BAD_DIMENSIONS;
+        return( NULL );
+    }
 
-    tga = fopen( file, "wb" );
-
-    if( tga == NULL ) {
-        TargaError = TGA_ERR_OPEN_FAILS;
-        return( 0 );
+    out = buf != NULL ? buf : (ubyte *)malloc( tga_encoded_size_max( width, height, format, rle ) );
+    if( out == NULL ) {
+        TargaError = TGA_ERR_MEM;
+        return( NULL );
     }
 
-    // write id length
-    fwrite( &idlen, 1, 1, tga );
+    if( !rle ) {
 
-    // write colormap type
-    fwrite( &cmap_type, 1, 1, tga );
+        // color correction -- data is in RGB, need BGR -- straight into place.
+        total = tga_build_header( out, width, height, format, TGA_IMG_UNC_TRUECOLOR );
 
-    // write image type
-    fwrite( &img_type, 1, 1, tga );
+        #pragma omp parallel for schedule( static )
+        for( row = 0; row < height; row++ ) {
+            tga_convert_row_out( out + total + (size_t)row * width * format, 
+                dat + (size_t)row * width * format, width, format );
+        }
 
-    // write cmap spec.
-    fwrite( &zeroes, 5, 1, tga );
+        *len = total + (size_t)width * height * format;
+        return( out );
 
-    // write image spec.
-    fwrite( &xorigin, 2, 1, tga );
-    fwrite( &yorigin, 2, 1, tga );
-    fwrite( &shortwidth, 2, 1, tga );
-    fwrite( &shortheight, 2, 1, tga );
-    fwrite( &pixdepth, 1, 1, tga );
-    fwrite( &img_desc, 1, 1, tga );
+    }
 
+    // packets never cross a row, so every row can be encoded on its own.  each
+    // one gets a worst case slot (all raw packets) and they're packed together after.
+    row_max = (size_t)width * format + (width + 127) / 128;
 
-    // write image id.
-    fwrite( &id, idlen, 1, tga );
+    // (one spare byte on the mallocs, so a zero-sized image doesn't look like a failure.)
+    row_len = (size_t *)malloc( height * sizeof( size_t ) + 1 );
+    if( row_len == NULL ) {
+        if( out != buf ) {
+            free( out );
+        }
+        TargaError = TGA_ERR_MEM;
+        return( NULL );
+    }
 
-    // initial color values -- just to shut up the compiler.
-    nc = 0;
+    #pragma omp parallel private( scratch )
+    {
+        // the current row, converted to BGR(A).
+        scratch = (ubyte *)malloc( width * format + 1 );
+        if( scratch == NULL ) {
+            #pragma omp critical
+            failed = 1;
+        }
+
+        // with a thread short of memory the others carry on, but it all gets thrown away.
+        #pragma omp for schedule( dynamic, 16 )
+        for( row = 0; row < height; row++ ) {
+            if( scratch != NULL ) {
+                tga_convert_row_out( scratch, dat + (size_t)row * width * format, width, format );
+                row_len[row] = tga_rle_encode_row( out + TGA_HEADER_BYTES + row_max * row, scratch, width, format );
+            }
+        }
+
+        free( scratch );
+    }
+
+    if( failed ) {
+        free( row_len );
+        if( out != buf ) {
+            free( out );
+        }
+        TargaError = TGA_ERR_MEM;
+        return( NULL );
+    }
+
+    total = tga_build_header( out, width, height, format, TGA_IMG_RLE_TRUECOLOR );
+    for( row = 0; row < height; row++ ) {
+        memmove( out + total, out + TGA_HEADER_BYTES + row_max * row, row_len[row] );
+        total += row_len[row];
+    }
+
+    free( row_len );
+
+    *len = total;
+    return( out );
+
+}
+
+
+
+
+/* encodes a whole targa and writes it out with a single fwrite */
+static int tga_write_encoded( const char * file, int width, int height, unsigned char * dat, 
+                             unsigned int format, int rle ) {
+
+    FILE * tga;
+
+    ubyte * out;
+    size_t len;
+    int ok;
+
+
+    switch( format ) {
+    case TGA_TRUECOLOR_24:
+    case TGA_TRUECOLOR_32:
+        break;
+
+    default:
+        TargaError = TGA_ERR_BAD_FORMAT;
+        return( 0 );
+    }
+
+    // encode first, so a failure there leaves any existing file as it was.
+    out = tga_encode_to_buffer( width, height, dat, format, rle, NULL, &len );
+    if( out == NULL ) {
+        return( 0 );
+    }
+
+    tga = fopen( file, "wb" );
+
+    if( tga == NULL ) {
+        free( out );
+        TargaError = TGA_ERR_OPEN_FAILS;
+        return( 0 );
+    }
+
+    // and out it all goes in one go.
+    ok = fwrite( out, len, 1, tga ) == 1;
+
+    if( fclose( tga ) != 0 ) {
+        ok = 0;
+    }
+
+    free( out );
+
+    if( !ok ) {
+        TargaError = TGA_ERR_WRITE_FAILS;
+    }
+
+    return( ok );
+
+}
+
+
+
+
+/* starts a raw targa for writing a band of rows at a time */
+tga_writer * tga_begin_write( const char * file, int width, int height, unsigned int format ) {
+
+    tga_writer * tga;
+    ubyte  hdr[TGA_HEADER_BYTES];
+    size_t hdr_len;
+
+    switch( format ) {
+
+    case TGA_TRUECOLOR_24:
+    case TGA_TRUECOLOR_32:
+        break;
+
+    default:
+        TargaError = TGA_ERR_BAD_FORMAT;
+        return( NULL );
+
+    }
+
+    if( width < 0 || height < 0 ) {
+        TargaError = TGA_ERR_BAD_DIMENSIONS;
+        return( NULL );
+    }
+
+    tga = (tga_writer *)calloc( 1, sizeof( tga_writer ) );
+    if( tga == NULL ) {
+        TargaError = TGA_ERR_MEM;
+        return( NULL );
+    }
+
+    tga->fp = fopen( file, "wb" );
+    if( tga->fp == NULL ) {
+        free( tga );
+        TargaError = TGA_ERR_OPEN_FAILS;
+        return( NULL );
+    }
+
+    tga->width  = width;
+    tga->height = height;
+    tga->format = format;
+
+    hdr_len = tga_build_header( hdr, width, height, format, TGA_IMG_UNC_TRUECOLOR );
+    if( fwrite( hdr, hdr_len, 1, tga->fp ) != 1 ) {
+        tga->failed = 1;
+    }
+
+    return( tga );
+
+}
+
+
+
+
+/* reopens a raw targa laid out exactly as tga_begin_write would lay it out, to rewrite some of its rows */
+tga_writer * tga_begin_update( const char * file, int width, int height, unsigned int format ) {
+
+    tga_writer * tga;
+    ubyte  want[TGA_HEADER_BYTES];
+    ubyte  have[TGA_HEADER_BYTES];
+    size_t hdr_len;
+    tga_off size;
+
+    if( format != TGA_TRUECOLOR_24 && format != TGA_TRUECOLOR_32 ) {
+        TargaError = TGA_ERR_BAD_FORMAT;
+        return( NULL );
+    }
+
+    if( width < 0 || height < 0 ) {
+        TargaError = TGA_ERR_BAD_DIMENSIONS;
+        return( NULL );
+    }
+
+    tga = (tga_writer *)calloc( 1, sizeof( tga_writer ) );
+    if( tga == NULL ) {
+        TargaError = TGA_ERR_MEM;
+        return( NULL );
+    }
+
+    tga->fp = fopen( file, "r+b" );
+    if( tga->fp == NULL ) {
+        free( tga );
+        TargaError = TGA_ERR_OPEN_FAILS;
+        return( NULL );
+    }
+
+    tga->width  = width;
+    tga->height = height;
+    tga->format = format;
+
+    // anything but our own header, or a file cut short or run on, gets written out whole instead.
+    hdr_len = tga_build_header( want, width, height, format, TGA_IMG_UNC_TRUECOLOR );
+    size = -1;
+    if( fread( have, hdr_len, 1, tga->fp ) == 1 && tga_fseek( tga->fp, 0, SEEK_END ) == 0 ) {
+        size = tga_ftell( tga->fp );
+    }
+
+    if( size != (tga_off)hdr_len + (tga_off)width * height * format || memcmp( have, want, hdr_len ) != 0 ) {
+        fclose( tga->fp );
+        free( tga );
+        TargaError = TGA_ERR_BAD_HEADER;
+        return( NULL );
+    }
+
+    return( tga );
+
+}
+
+
+
+
+/* says whether the rows that follow all have full alpha, which lets them skip un-premultiplying */
+void tga_write_opaque( tga_writer * tga, int opaque ) {
+
+    tga->opaque = opaque;
+
+}
+
+
+
+
+/* writes rows [row, row + count) of the image, counting down from the top row, from dat */
+int tga_write_rows( tga_writer * tga, int row, int count, unsigned char * dat ) {
+
+    size_t row_bytes;
+    int    r;
+
+    if( row < 0 || count < 0 || (uint32)(row + count) > tga->height ) {
+        TargaError = TGA_ERR_BAD_DIMENSIONS;
+        return( 0 );
+    }
+
+    if( count == 0 ) {
+        return( 1 );
+    }
+
+    row_bytes = (size_t)tga->width * tga->format;
+
+    if( tga->band_rows < (size_t)count ) {
+        free( tga->band );
+        tga->band = (ubyte *)malloc( row_bytes * count + 1 );
+        tga->band_rows = tga->band != NULL ? count : 0;
+        if( tga->band == NULL ) {
+            TargaError = TGA_ERR_MEM;
+            return( 0 );
+        }
+    }
+
+    // the file is bottom-up, so the band goes in backwards ...
+    for( r = 0; r < count; r++ ) {
+        if( tga->opaque && tga->format == TGA_TRUECOLOR_32 ) {
+            tga_swizzle( tga->band + (count - 1 - r) * row_bytes, dat + r * row_bytes, tga->width );
+        } else {
+            tga_convert_row_out( tga->band + (count - 1 - r) * row_bytes, dat + r * row_bytes, 
+                tga->width, tga->format );
+        }
+    }
+
+    // ... and finishes where the row below it starts.
+    if( tga_fseek( tga->fp, (tga_off)TGA_HEADER_BYTES + (tga_off)(tga->height - row - count) * row_bytes, 
+            SEEK_SET ) != 0 || 
+        fwrite( tga->band, row_bytes * count, 1, tga->fp ) != 1 ) {
+        tga->failed = 1;
+        TargaError = TGA_ERR_WRITE_FAILS;
+        return( 0 );
+    }
+
+    return( 1 );
+
+}
+
+
+
+
+/* finishes off a targa written with tga_write_rows */
+int tga_end_write( tga_writer * tga ) {
+
+    int ok;
+
+    if( tga == NULL ) {
+        return( 0 );
+    }
+
+    ok = !tga->failed;
+    if( fclose( tga->fp ) != 0 ) {
+        ok = 0;
+    }
+
+    free( tga->band );
+    free( tga );
+
+    if( !ok ) {
+        TargaError = TGA_ERR_WRITE_FAILS;
+    }
+
+    return( ok );
+
+}
 
-    // color correction -- data is in RGB, need BGR.
-    // also run-length-encoding.
-    for( i = 0; i < size; i++ ) {
 
-        idx = i * format;
 
-        row = i / width;
-        column = i % width;
 
-        //printf( "row: %d, col: %d\n", row, column );
-        pixbuf = 0;
-        for( j = 0; j < format; j++ ) {
-            pixbuf += dat[idx+j] << (8 * j);
+/*
+   Pixel conversion kernels.  The SSE2 versions do exactly the same float
+   arithmetic, in the same order, as the scalar code after them, so both give
+   bit-for-bit the same bytes.  Counts are in pixels.
+*/
+
+#ifdef TGA_USE_SSE2
+
+/* one pixel per call -- the lanes hold B, G, R, A; the result holds premultiplied R, G, B, A */
+static __m128i tga_premultiply_sse2( __m128i p ) {
+
+    const __m128  scale = _mm_set1_ps( 255.0f );
+    const __m128i alpha_lane = _mm_set_epi32( -1, 0, 0, 0 );
+    __m128 c, a;
+    __m128i q;
+
+    c = _mm_div_ps( _mm_cvtepi32_ps( p ), scale );
+    a = _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+    q = _mm_cvttps_epi32( _mm_mul_ps( _mm_mul_ps( c, a ), scale ) );
+
+    // alpha passes through untouched, then B and R trade places.
+    q = _mm_or_si128( _mm_andnot_si128( alpha_lane, q ), _mm_and_si128( alpha_lane, p ) );
+    return( _mm_shuffle_epi32( q, _MM_SHUFFLE( 3, 0, 1, 2 ) ) );
+
+}
+
+
+/* one pixel per call -- the lanes hold premultiplied R, G, B, A; the result holds B, G, R, A */
+static __m128i tga_unpremultiply_sse2( __m128i p ) {
+
+    const __m128  scale = _mm_set1_ps( 255.0f );
+    const __m128  color_lanes = _mm_castsi128_ps( _mm_set_epi32( 0, -1, -1, -1 ) );
+    __m128 c, a, mask;
+
+    c = _mm_div_ps( _mm_cvtepi32_ps( p ), scale );
+    a = _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+
+    // only the colors get divided, and only if there's some alpha to divide by.
+    mask = _mm_and_ps( _mm_cmpgt_ps( a, _mm_set1_ps( 0.0001f ) ), color_lanes );
+    c = _mm_or_ps( _mm_and_ps( mask, _mm_div_ps( c, a ) ), _mm_andnot_ps( mask, c ) );
+
+    /* clamp to 1.0f */
+    mask = _mm_cmpgt_ps( c, _mm_set1_ps( 1.0f ) );
+    c = _mm_or_ps( _mm_and_ps( mask, scale ), _mm_andnot_ps( mask, _mm_mul_ps( c, scale ) ) );
+
+    return( _mm_shuffle_epi32( _mm_cvttps_epi32( c ), _MM_SHUFFLE( 3, 0, 1, 2 ) ) );
+
+}
+
+
+/* one pixel per call -- the lanes hold premultiplied R, G, B, A; the result holds R, G, B over black */
+static __m128i tga_unpremultiply_rgb_sse2( __m128i p ) {
+
+    __m128 f, a;
+    __m128i v;
+
+    f = _mm_cvtepi32_ps( p );
+    a = _mm_shuffle_ps( f, f, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+
+    // nothing is negative, so truncating is the same as floor.
+    f = _mm_mul_ps( f, _mm_div_ps( _mm_set1_ps( 255.0f ), a ) );
+    v = _mm_cvttps_epi32( _mm_min_ps( f, _mm_set1_ps( 255.0f ) ) );
+
+    // zero alpha shows the background.
+    return( _mm_and_si128( v, _mm_castps_si128( _mm_cmpneq_ps( a, _mm_setzero_ps() ) ) ) );
+
+}
+
+#endif
+
+
+/* straight BGRA (as stored in a file) to premultiplied RGBA */
+void tga_swizzle_premultiply( unsigned char * dst, const unsigned char * src, int count ) {
+
+    const ubyte * pm;
+    int i = 0;
+
+#ifdef TGA_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v, lo, hi;
+
+    for( ; i + 4 <= count; i += 4 ) {
+        v  = _mm_loadu_si128( (const __m128i *)(src + i * 4) );
+        lo = _mm_unpacklo_epi8( v, zero );
+        hi = _mm_unpackhi_epi8( v, zero );
+        lo = _mm_packs_epi32( tga_premultiply_sse2( _mm_unpacklo_epi16( lo, zero ) ),
+                              tga_premultiply_sse2( _mm_unpackhi_epi16( lo, zero ) ) );
+        hi = _mm_packs_epi32( tga_premultiply_sse2( _mm_unpacklo_epi16( hi, zero ) ),
+                              tga_premultiply_sse2( _mm_unpackhi_epi16( hi, zero ) ) );
+        _mm_storeu_si128( (__m128i *)(dst + i * 4), _mm_packus_epi16( lo, hi ) );
+    }
+#endif
+
+    tga_init_tables();
+
+    for( ; i < count; i++ ) {
+        ubyte b = src[i * 4];
+        ubyte g = src[i * 4 + 1];
+        ubyte r = src[i * 4 + 2];
+        ubyte a = src[i * 4 + 3];
+        pm = tga_premult[a];
+        dst[i * 4]     = pm[r];
+        dst[i * 4 + 1] = pm[g];
+        dst[i * 4 + 2] = pm[b];
+        dst[i * 4 + 3] = a;
+    }
+
+}
+
+
+/* premultiplied RGBA to straight BGRA (as stored in a file), clamped */
+void tga_swizzle_unpremultiply( unsigned char * dst, const unsigned char * src, int count ) {
+
+    float red, green, blue, alpha;
+    int i = 0;
+
+#ifdef TGA_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v, lo, hi;
+
+    for( ; i + 4 <= count; i += 4 ) {
+        v  = _mm_loadu_si128( (const __m128i *)(src + i * 4) );
+        lo = _mm_unpacklo_epi8( v, zero );
+        hi = _mm_unpackhi_epi8( v, zero );
+        lo = _mm_packs_epi32( tga_unpremultiply_sse2( _mm_unpacklo_epi16( lo, zero ) ),
+                              tga_unpremultiply_sse2( _mm_unpackhi_epi16( lo, zero ) ) );
+        hi = _mm_packs_epi32( tga_unpremultiply_sse2( _mm_unpacklo_epi16( hi, zero ) ),
+                              tga_unpremultiply_sse2( _mm_unpackhi_epi16( hi, zero ) ) );
+        _mm_storeu_si128( (__m128i *)(dst + i * 4), _mm_packus_epi16( lo, hi ) );
+    }
+#endif
+
+    for( ; i < count; i++ ) {
+
+        red     = src[i * 4] / 255.0f;
+        green   = src[i * 4 + 1] / 255.0f;
+        blue    = src[i * 4 + 2] / 255.0f;
+        alpha   = src[i * 4 + 3] / 255.0f;
+
+        if( alpha > 0.0001 ) {
+            red /= alpha;
+            green /= alpha;
+            blue /= alpha;
+        }
+
+        /* clamp to 1.0f */
+
+        red = red > 1.0f ? 255.0f : red * 255.0f;
+        green = green > 1.0f ? 255.0f : green * 255.0f;
+        blue = blue > 1.0f ? 255.0f : blue * 255.0f;
+        alpha = alpha > 1.0f ? 255.0f : alpha * 255.0f;
+
+        dst[i * 4]     = (ubyte)blue;
+        dst[i * 4 + 1] = (ubyte)green;
+        dst[i * 4 + 2] = (ubyte)red;
+        dst[i * 4 + 3] = (ubyte)alpha;
+
+    }
+
+}
+
+
+/* premultiplied RGBA to 24-bit RGB composited over a black background */
+void tga_unpremultiply_rgb( unsigned char * rgb, const unsigned char * rgba, int count ) {
+
+    float alpha_scale;
+    int   val;
+    int   i = 0;
+    int   j;
+
+#ifdef TGA_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v, lo, hi;
+    ubyte  out[16];
+
+    for( ; i + 4 <= count; i += 4 ) {
+        v  = _mm_loadu_si128( (const __m128i *)(rgba + i * 4) );
+        lo = _mm_unpacklo_epi8( v, zero );
+        hi = _mm_unpackhi_epi8( v, zero );
+        lo = _mm_packs_epi32( tga_unpremultiply_rgb_sse2( _mm_unpacklo_epi16( lo, zero ) ),
+                              tga_unpremultiply_rgb_sse2( _mm_unpackhi_epi16( lo, zero ) ) );
+        hi = _mm_packs_epi32( tga_unpremultiply_rgb_sse2( _mm_unpacklo_epi16( hi, zero ) ),
+                              tga_unpremultiply_rgb_sse2( _mm_unpackhi_epi16( hi, zero ) ) );
+        _mm_storeu_si128( (__m128i *)out, _mm_packus_epi16( lo, hi ) );
+        for( j = 0; j < 4; j++ ) {
+            rgb[(i + j) * 3]     = out[j * 4];
+            rgb[(i + j) * 3 + 1] = out[j * 4 + 1];
+            rgb[(i + j) * 3 + 2] = out[j * 4 + 2];
+        }
+    }
+#endif
+
+    for( ; i < count; i++ ) {
+
+        if( rgba[i * 4 + 3] == 0 ) {
+            rgb[i * 3] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = 0;
+            continue;
+        }
+
+        alpha_scale = (float)255 / (float)rgba[i * 4 + 3];
+
+        for( j = 0; j < 3; j++ ) {
+            val = (int)floor( rgba[i * 4 + j] * alpha_scale );
+            rgb[i * 3 + j] = val > 255 ? 255 : (ubyte)val;
+        }
+
+    }
+
+}
+
+
+
+
+
+/*************************************************************************************************/
+
+
+
+
+
+/* writes the header and image id for an image we're saving, returning its length */
+static size_t tga_build_header( ubyte * hdr, int width, int height, unsigned int format, ubyte img_type ) {
+
+    const char id[] = "written with libtarga";
+    const ubyte idlen = 21;
+
+    memset( hdr, 0, HDR_LENGTH );
+
+    hdr[HDR_IDLEN]                   = idlen;
+    hdr[HDR_CMAP_TYPE]               = 0;
+    hdr[HDR_IMAGE_TYPE]              = img_type;  // 2 - uncompressed truecolor  10 - RLE truecolor
+
+    // cmap spec and origin are all zeroes.
+    hdr[HDR_IMG_SPEC_WIDTH]          = (ubyte)(width & 0xFF);
+    hdr[HDR_IMG_SPEC_WIDTH + 1]      = (ubyte)((width >> 8) & 0xFF);
+    hdr[HDR_IMG_SPEC_HEIGHT]         = (ubyte)(height & 0xFF);
+    hdr[HDR_IMG_SPEC_HEIGHT + 1]     = (ubyte)((height >> 8) & 0xFF);
+    hdr[HDR_IMG_SPEC_PIX_DEPTH]      = (ubyte)(format * 8);  // bpp
+    hdr[HDR_IMG_SPEC_IMG_DESC]       = format == TGA_TRUECOLOR_32 ? 8 : 0;
+
+    memcpy( hdr + HDR_LENGTH, id, idlen );
+
+    return( HDR_LENGTH + idlen );
+
+}
+
+
+
+
+/* color correction for writing -- data is in RGB, need BGR (and straight alpha) */
+static void tga_convert_row_out( ubyte * dst, const ubyte * src, int width, unsigned int format ) {
+
+    int j;
+
+    switch( format ) {
+
+    case TGA_TRUECOLOR_24:
+
+        for( j = 0; j < width; j++ ) {
+            dst[j * 3]     = src[j * 3 + 2];
+            dst[j * 3 + 1] = src[j * 3 + 1];
+            dst[j * 3 + 2] = src[j * 3];
         }
+        break;
 
-        switch( format ) {
+    case TGA_TRUECOLOR_32:
+
+        /* need to un-premultiply alpha.. */
+        tga_swizzle_unpremultiply( dst, src, width );
+        break;
+
+    }
 
-        case TGA_TRUECOLOR_24:
+}
+
+
+
+
+/* RGBA to BGRA and back, for pixels whose alpha is 255 -- premultiplied and straight are the same then */
+static void tga_swizzle( ubyte * dst, const ubyte * src, int count ) {
+
+    int i;
+
+    for( i = 0; i < count; i++ ) {
+        dst[i * 4]     = src[i * 4 + 2];
+        dst[i * 4 + 1] = src[i * 4 + 1];
+        dst[i * 4 + 2] = src[i * 4];
+        dst[i * 4 + 3] = src[i * 4 + 3];
+    }
 
-            pixbuf = ((pixbuf & 0xFF) << 16) + 
-                     (pixbuf & 0xFF00) + 
-                     ((pixbuf & 0xFF0000) >> 16);
+}
 
-            pixbuf = htotl( pixbuf );
-            break;
 
-        case TGA_TRUECOLOR_32:
 
-            /* need to un-premultiply alpha.. */
 
-            red     = (pixbuf & 0xFF) / 255.0f;
-            green   = ((pixbuf & 0xFF00) >> 8) / 255.0f;
-            blue    = ((pixbuf & 0xFF0000) >> 16) / 255.0f;
-            alpha   = ((pixbuf & 0xFF000000) >> 24) / 255.0f;
+/* run-length encodes one already converted row, returning the number of bytes written */
+static size_t tga_rle_encode_row( ubyte * out, const ubyte * row, int width, unsigned int format ) {
 
-            if( alpha > 0.0001 ) {
-                red /= alpha;
-                green /= alpha;
-                blue /= alpha;
-            }
+    ubyte * start = out;
+    int i = 0;
+    int run;
 
-            /* clamp to 1.0f */
+    while( i < width ) {
 
-            red = red > 1.0f ? 255.0f : red * 255.0f;
-            green = green > 1.0f ? 255.0f : green * 255.0f;
-            blue = blue > 1.0f ? 255.0f : blue * 255.0f;
-            alpha = alpha > 1.0f ? 255.0f : alpha * 255.0f;
+        // how many copies of this pixel are there?
+        run = 1;
+        while( i + run < width && run < 128 && 
+               !memcmp( row + i * format, row + (i + run) * format, format ) ) {
+            run++;
+        }
 
-            pixbuf = (ubyte)blue + (((ubyte)green) << 8) + 
-                (((ubyte)red) << 16) + (((ubyte)alpha) << 24);
-                
-            pixbuf = htotl( pixbuf );
-            break;
+        if( run > 1 ) {
+            /* run length packet */
+            *out++ = (ubyte)(0x80 | (run - 1));
+            memcpy( out, row + i * format, format );
+            out += format;
+            i += run;
+            continue;
+        }
 
+        // raw packet -- goes until the next pair of equal pixels.
+        run = 1;
+        while( i + run < width && run < 128 && 
+               (i + run + 1 >= width || 
+                memcmp( row + (i + run) * format, row + (i + run + 1) * format, format )) ) {
+            run++;
         }
 
+        *out++ = (ubyte)(run - 1);
+        memcpy( out, row + i * format, run * format );
+        out += run * format;
+        i += run;
 
-        oc = nc;
+    }
 
-        nc = pixbuf;
+    return( out - start );
 
+}
 
-        switch( state ) {
 
-        case INIT:
-            // this is just used to make sure we have 2 pixel values to consider.
-            state = NONE;
-            break;
 
 
-        case NONE:
+static int tga_map_file( const char * filename, tga_file_map * map ) {
 
-            if( column == 0 ) {
-                // write a 1 pixel raw packet for the old pixel, then go thru again.
-                repcount = 0;
-                fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-                state = NONE;
-                break;
-            }
+    FILE * file;
+    ubyte * buf;
+    long   len;
 
-            if( nc == oc ) {
-                repcount = 0;
-                state = RLP;
-            } else {
-                repcount = 0;
-                state = RAWP;
-                for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-                    rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-                    rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
+#ifdef _WIN32
+    HANDLE handle;
+    HANDLE mapping;
+    LARGE_INTEGER size;
+
+    handle = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, 
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( handle != INVALID_HANDLE_VALUE ) {
+        if( GetFileSizeEx( handle, &size ) && size.QuadPart > 0 && 
+            (unsigned __int64)size.QuadPart <= (size_t)-1 ) {
+            mapping = CreateFileMappingA( handle, NULL, PAGE_READONLY, 0, 0, NULL );
+            if( mapping != NULL ) {
+                // the view keeps the mapping alive once both handles are gone.
+                map->base = (const ubyte *)MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+                CloseHandle( mapping );
+                if( map->base != NULL ) {
+                    CloseHandle( handle );
+                    map->len = (size_t)size.QuadPart;
+                    map->mapped = 1;
+                    return( 1 );
                 }
             }
-            break;
-
-
-        case RLP:
-            repcount++;
-
-            if( column == 0 ) {
-                // finish off rlp.
-                repcount |= 0x80;
-                fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
+        }
+        CloseHandle( handle );
+    }
 #else
-                fwrite( &oc, format, 1, tga );
-#endif
-                state = NONE;
-                break;
+    int fd;
+    struct stat st;
+    void * base;
+
+    fd = open( filename, O_RDONLY );
+    if( fd >= 0 ) {
+        if( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0 && 
+            (unsigned long long)st.st_size <= (size_t)-1 ) {
+            base = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if( base != MAP_FAILED ) {
+                close( fd );
+                madvise( base, (size_t)st.st_size, MADV_SEQUENTIAL );
+                map->base = (const ubyte *)base;
+                map->len = (size_t)st.st_size;
+                map->mapped = 1;
+                return( 1 );
             }
-
-            if( repcount == 127 ) {
-                // finish off rlp.
-                repcount |= 0x80;
-                fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
+        }
+        close( fd );
+    }
 #endif
-                state = NONE;
-                break;
-            }
 
-            if( nc != oc ) {
-                // finish off rlp
-                repcount |= 0x80;
-                fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-                state = NONE;
-            }
-            break;
+    // can't map it (empty file, pipe, ...) -- just read the whole thing in.
+    file = fopen( filename, "rb" );
+    if( file == NULL ) {
+        TargaError = TGA_ERR_OPEN_FAILS;
+        return( 0 );
+    }
 
+    fseek( file, 0, SEEK_END );
+    len = ftell( file );
+    fseek( file, 0, SEEK_SET );
+    if( len < 0 ) {
+        len = 0;
+    }
 
-        case RAWP:
-            repcount++;
+    buf = (ubyte *)malloc( len + 1 );
+    if( buf == NULL ) {
+        fclose( file );
+        TargaError = TGA_ERR_MEM;
+        return( 0 );
+    }
 
-            if( column == 0 ) {
-                // finish off rawp.
-                for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-                    rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-                    rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
-                }
-                fwrite( &repcount, 1, 1, tga );
-                fwrite( rawbuf, (repcount + 1) * format, 1, tga );
-                state = NONE;
-                break;
-            }
+    map->base = buf;
+    map->len = fread( buf, 1, len, file );
+    map->mapped = 0;
 
-            if( repcount == 127 ) {
-                // finish off rawp.
-                for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-                    rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-                    rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
-                }
-                fwrite( &repcount, 1, 1, tga );
-                fwrite( rawbuf, (repcount + 1) * format, 1, tga );
-                state = NONE;
-                break;
-            }
+    fclose( file );
 
-            if( nc == oc ) {
-                // finish off rawp
-                repcount--;
-                fwrite( &repcount, 1, 1, tga );
-                fwrite( rawbuf, (repcount + 1) * format, 1, tga );
-                
-                // start new rlp
-                repcount = 0;
-                state = RLP;
-                break;
-            }
+    return( 1 );
+
+}
 
-            // continue making rawp
-            for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-                rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-                rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
-            }
 
-            break;
 
-        }
-       
 
+static void tga_unmap_file( tga_file_map * map ) {
+
+    if( map->base == NULL ) {
+        return;
     }
 
+    if( map->mapped ) {
+#ifdef _WIN32
+        UnmapViewOfFile( (LPCVOID)map->base );
+#else
+        munmap( (void *)map->base, map->len );
+#endif
+    } else {
+        free( (void *)map->base );
+    }
 
-    // clean up state.
+    map->base = NULL;
 
-    switch( state ) {
+}
 
-    case INIT:
-        break;
 
-    case NONE:
-        // write the last 2 pixels in a raw packet.
-        fwrite( &one, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&nc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &nc, format, 1, tga );
-#endif
-        break;
 
-    case RLP:
-        repcount++;
-        repcount |= 0x80;
-        fwrite( &repcount, 1, 1, tga );
-#ifdef WORDS_BIGENDIAN
-                fwrite( (&oc)+4, format, 1, tga );  // byte order..
-#else
-                fwrite( &oc, format, 1, tga );
-#endif
-        break;
 
-    case RAWP:
-        repcount++;
-        for( j = 0; j < format; j++ ) {
-#ifdef WORDS_BIGENDIAN
-            rawbuf[(repcount * format) + j] = (ubyte)(*((&oc)+format-j-1));
-#else
-            rawbuf[(repcount * format) + j] = *(((ubyte *)(&oc)) + j);
-#endif
-        }
-        fwrite( &repcount, 1, 1, tga );
-        fwrite( rawbuf, (repcount + 1) * 3, 1, tga );
-        break;
+static const tga_decoder * tga_reader_decoder( tga_reader * tga, uint32 format ) {
 
+    if( tga->dec.format != format ) {
+        tga_decoder_free( &tga->dec );
+        tga_decoder_init( &tga->dec, tga->width, tga->height, tga->bytes_per_pix, tga->true_bits, 
+            tga->alphabits, tga->img_desc, format, tga->colormap, tga->cmap_bytes_entry, tga->cmap_length );
     }
 
+    return( &tga->dec );
+
+}
 
-    // close the file.
-    fclose( tga );
 
-    free( rawbuf );
 
-    return( 1 );
 
-}
+static void tga_init_tables( void ) {
 
+    uint32 a, c;
 
+    if( tga_tables_ready ) {
+        return;
+    }
 
+    for( a = 0; a < 256; a++ ) {
+        for( c = 0; c < 256; c++ ) {
+            tga_premult[a][c] = (ubyte)(((float)c / 255.0f) * ((float)a / 255.0f) * 255.0f);
+        }
+    }
 
+    tga_tables_ready = 1;
 
-/*************************************************************************************************/
+}
 
 
 
 
+static void tga_decoder_init( tga_decoder * dec, uint32 w, uint32 h, ubyte bytes_per_pix, ubyte true_bits,
+                             ubyte alphabits, ubyte img_desc, uint32 format, 
+                             ubyte * colormap, ubyte cmap_bytes_entry, uint32 cmap_length ) {
 
-static void tga_write_pixel_to_mem( ubyte * dat, ubyte img_spec, uint32 number, 
-                                   uint32 w, uint32 h, uint32 pixel, uint32 format ) {
+    ubyte  unit[4] = { 0, 0, 0, 0 };
+    uint32 entries;
+    uint32 i;
 
-    // write the pixel to the data regarding how the
-    // header says the data is ordered.
+    tga_init_tables();
+
+    dec->width            = w;
+    dec->height           = h;
+    dec->bytes_per_pix    = bytes_per_pix;
+    dec->true_bits        = true_bits;
+    dec->alphabits        = alphabits;
+    dec->img_desc         = img_desc;
+    dec->format           = format;
+    dec->colormap         = colormap;
+    dec->cmap_bytes_entry = cmap_bytes_entry;
+    dec->cmap_length      = cmap_length;
+    dec->lut              = NULL;
+
+    dec->zero = tga_decode_pixel( dec, unit );
+
+    // small data units (indices, 15/16 bit color, grayscale) can only take on
+    // a few values, so convert every one of them up front.
+    if( bytes_per_pix <= 2 ) {
+
+        entries = 1 << (bytes_per_pix * 8);
+        dec->lut = (uint32 *)malloc( entries * sizeof( uint32 ) );
+
+        for( i = 0; i < entries; i++ ) {
+            unit[0] = (ubyte)(i & 0xFF);
+            unit[1] = (ubyte)(i >> 8);
+            dec->lut[i] = tga_decode_pixel( dec, unit );
+        }
 
-    uint32 j;
-    uint32 x, y;
-    uint32 addy;
+    }
 
-    switch( (img_spec & 0x30) >> 4 ) {
+}
 
-    case TGA_LOWER_RIGHT:
-        x = w - 1 - (number % w);
-        y = number / h;
-        break;
 
-    case TGA_UPPER_LEFT:
-        x = number % w;
-        y = h - 1 - (number / w);
-        break;
 
-    case TGA_UPPER_RIGHT:
-        x = w - 1 - (number % w);
-        y = h - 1 - (number / w);
-        break;
 
-    case TGA_LOWER_LEFT:
-    default:
-        x = number % w;
-        y = number / w;
-        break;
+static void tga_decoder_free( tga_decoder * dec ) {
 
-    }
+    free( dec->lut );
+    dec->lut = NULL;
 
-    addy = (y * w + x) * format;
-    for( j = 0; j < format; j++ ) {
-        dat[addy + j] = (ubyte)((pixel >> (j * 8)) & 0xFF);
-    }
-    
 }
 
 
 
 
-static uint32 tga_get_pixel( FILE * tga, ubyte bytes_per_pix, 
-                            ubyte * colormap, ubyte cmap_bytes_entry ) {
-    
+static uint32 tga_decode_pixel( const tga_decoder * dec, const ubyte * src ) {
+
     /* get the image data value out */
 
     uint32 tmp_col;
     uint32 tmp_int32;
-    ubyte tmp_byte;
 
     uint32 j;
 
     tmp_int32 = 0;
-    for( j = 0; j < bytes_per_pix; j++ ) {
-        if( fread( &tmp_byte, 1, 1, tga ) < 1 ) {
-            tmp_int32 = 0;
-        } else {
-            tmp_int32 += tmp_byte << (j * 8);
-        }
+    for( j = 0; j < dec->bytes_per_pix; j++ ) {
+        tmp_int32 += src[j] << (j * 8);
     }
     
     /* byte-order correct the thing */
-    switch( bytes_per_pix ) {
+    switch( dec->bytes_per_pix ) {
         
     case 2:
         tmp_int32 = ttohs( (uint16)tmp_int32 );
@@ -1048,23 +1713,313 @@ static uint32 tga_get_pixel( FILE * tga, ubyte bytes_per_pix,
         
     }
     
-    if( colormap != NULL ) {
+    if( dec->colormap != NULL ) {
         /* need to look up value to get real color */
+        if( tmp_int32 >= dec->cmap_length ) {
+            tmp_int32 = 0;
+        }
         tmp_col = 0;
-        for( j = 0; j < cmap_bytes_entry; j++ ) {
-            tmp_col += colormap[cmap_bytes_entry * tmp_int32 + j] << (8 * j);
+        for( j = 0; j < dec->cmap_bytes_entry; j++ ) {
+            tmp_col += dec->colormap[dec->cmap_bytes_entry * tmp_int32 + j] << (8 * j);
         }
     } else {
         tmp_col = tmp_int32;
     }
     
-    return( tmp_col );
+    return( tga_convert_color( tmp_col, dec->true_bits, dec->alphabits, dec->format ) );
     
 }
 
 
 
 
+/* converts 'count' data units along one row of the image */
+static void tga_decode_span( const tga_decoder * dec, const ubyte * src, uint32 count, 
+                            ubyte * dst, int step ) {
+
+    const ubyte * pm;
+    uint32 pixel;
+    uint32 i;
+
+    if( dec->lut != NULL ) {
+
+        if( dec->bytes_per_pix == 1 ) {
+            for( i = 0; i < count; i++, src++, dst += step ) {
+                pixel = dec->lut[src[0]];
+                dst[0] = (ubyte)pixel;
+                dst[1] = (ubyte)(pixel >> 8);
+                dst[2] = (ubyte)(pixel >> 16);
+                if( dec->format == TGA_TRUECOLOR_32 ) {
+                    dst[3] = (ubyte)(pixel >> 24);
+                }
+            }
+        } else {
+            for( i = 0; i < count; i++, src += 2, dst += step ) {
+                pixel = dec->lut[src[0] | (src[1] << 8)];
+                dst[0] = (ubyte)pixel;
+                dst[1] = (ubyte)(pixel >> 8);
+                dst[2] = (ubyte)(pixel >> 16);
+                if( dec->format == TGA_TRUECOLOR_32 ) {
+                    dst[3] = (ubyte)(pixel >> 24);
+                }
+            }
+        }
+
+    } else if( dec->colormap == NULL && dec->bytes_per_pix == 3 && dec->true_bits == 24 ) {
+
+        // BGR, alpha forced to full.
+        pm = tga_premult[255];
+        for( i = 0; i < count; i++, src += 3, dst += step ) {
+            dst[0] = pm[src[2]];
+            dst[1] = pm[src[1]];
+            dst[2] = pm[src[0]];
+            if( dec->format == TGA_TRUECOLOR_32 ) {
+                dst[3] = 255;
+            }
+        }
+
+    } else if( dec->colormap == NULL && dec->bytes_per_pix == 4 && dec->true_bits == 32 ) {
+
+        // BGRA, alpha forced to full if the descriptor says there's no alpha.
+        if( dec->alphabits && dec->format == TGA_TRUECOLOR_32 && step == 4 ) {
+            tga_swizzle_premultiply( dst, src, count );
+            return;
+        }
+
+        for( i = 0; i < count; i++, src += 4, dst += step ) {
+            pm = tga_premult[dec->alphabits ? src[3] : 255];
+            dst[0] = pm[src[2]];
+            dst[1] = pm[src[1]];
+            dst[2] = pm[src[0]];
+            if( dec->format == TGA_TRUECOLOR_32 ) {
+                dst[3] = dec->alphabits ? src[3] : 255;
+            }
+        }
+
+    } else {
+
+        // anything unusual (wide colormap indices, odd depths) goes pixel by pixel.
+        for( i = 0; i < count; i++, src += dec->bytes_per_pix, dst += step ) {
+            pixel = tga_decode_pixel( dec, src );
+            dst[0] = (ubyte)pixel;
+            dst[1] = (ubyte)(pixel >> 8);
+            dst[2] = (ubyte)(pixel >> 16);
+            if( dec->format == TGA_TRUECOLOR_32 ) {
+                dst[3] = (ubyte)(pixel >> 24);
+            }
+        }
+
+    }
+
+}
+
+
+
+
+/* writes 'count' copies of an already converted pixel along one row of the image */
+static void tga_fill_span( const tga_decoder * dec, uint32 pixel, uint32 count, ubyte * dst, int step ) {
+
+    ubyte  px[4];
+    uint32 format = dec->format;
+    uint32 done;
+    uint32 n;
+
+    if( count == 0 ) {
+        return;
+    }
+
+    px[0] = (ubyte)pixel;
+    px[1] = (ubyte)(pixel >> 8);
+    px[2] = (ubyte)(pixel >> 16);
+    px[3] = (ubyte)(pixel >> 24);
+
+    // every pixel's the same, so a right-to-left row can be filled left to right.
+    if( step < 0 ) {
+        dst -= (count - 1) * format;
+    }
+
+    if( px[0] == px[1] && px[1] == px[2] && (format == TGA_TRUECOLOR_24 || px[2] == px[3]) ) {
+        memset( dst, px[0], count * format );
+        return;
+    }
+
+    // otherwise keep doubling what's been written, so the copies get wider as they go.
+    memcpy( dst, px, format );
+    for( done = 1; done < count; done += n ) {
+        n = done < count - done ? done : count - done;
+        memcpy( dst + done * format, dst, n * format );
+    }
+
+}
+
+
+
+
+/* decodes rows [row, row + count) counting down from the top, the first into dat and each 
+   following one 'stride' bytes on from the last.  returns 0 if it runs out of memory */
+static int tga_decode_rows( tga_reader * tga, const tga_decoder * dec, uint32 row, uint32 count, 
+                            ubyte * dat, ptrdiff_t stride ) {
+
+    size_t row_bytes = (size_t)tga->width * tga->bytes_per_pix;
+    int    rle;
+    int    r;
+
+    rle = tga->image_type == TGA_IMG_RLE_TRUECOLOR || 
+          tga->image_type == TGA_IMG_RLE_GRAYSCALE || 
+          tga->image_type == TGA_IMG_RLE_PALETTED;
+
+    // packets don't line up with rows, so find where each row starts before splitting them up.
+    if( rle && tga->rle_rows == NULL && !tga_rle_prescan( tga ) ) {
+        return( 0 );
+    }
+
+    #pragma omp parallel for schedule( static )
+    for( r = (int)row; r < (int)(row + count); r++ ) {
+
+        uint32 file_row;
+        size_t have;
+        int    step;
+        ubyte * dst;
+        tga_rle_state st;
+
+        // flip bottom-up files as we go.
+        file_row = (tga->img_desc & 0x20) ? (uint32)r : tga->height - 1 - r;
+
+        dst = dat + (r - (int)row) * stride;
+        if( tga->img_desc & 0x10 ) {
+            dst += (tga->width - 1) * dec->format;
+            step = -(int)dec->format;
+        } else {
+            step = dec->format;
+        }
+
+        if( rle ) {
+            st = tga->rle_rows[file_row];
+            tga_rle_walk( tga, dec, &st, tga->width, dst, step );
+        } else if( file_row * row_bytes + row_bytes <= tga->payload_len ) {
+            tga_decode_span( dec, tga->payload + file_row * row_bytes, tga->width, dst, step );
+        } else {
+            // a short file leaves the missing pixels (including a partial one) as zero.
+            have = file_row * row_bytes < tga->payload_len ? 
+                (tga->payload_len - file_row * row_bytes) / tga->bytes_per_pix : 0;
+            tga_decode_span( dec, tga->payload + file_row * row_bytes, (uint32)have, dst, step );
+            tga_fill_span( dec, dec->zero, tga->width - (uint32)have, dst + (int)have * step, step );
+        }
+
+    }
+
+    return( 1 );
+
+}
+
+
+
+
+/* steps through the packet headers once, noting where the stream stands as each row begins.
+   returns 0 if there's no memory for that */
+static int tga_rle_prescan( tga_reader * tga ) {
+
+    tga_rle_state st;
+    uint32 y;
+
+    tga->rle_rows = (tga_rle_state *)malloc( tga->height * sizeof( tga_rle_state ) + 1 );
+    if( tga->rle_rows == NULL ) {
+        TargaError = TGA_ERR_MEM;
+        return( 0 );
+    }
+
+    memset( &st, 0, sizeof( st ) );
+    for( y = 0; y < tga->height; y++ ) {
+        tga->rle_rows[y] = st;
+        tga_rle_walk( tga, NULL, &st, tga->width, NULL, 0 );
+    }
+
+    return( 1 );
+
+}
+
+
+
+
+/* decodes the next 'count' pixels of a run-length encoded payload, or with no dst just skips them */
+static void tga_rle_walk( const tga_reader * tga, const tga_decoder * dec, tga_rle_state * st, 
+                         uint32 count, ubyte * dst, int step ) {
+
+    const ubyte * src = tga->payload;
+    size_t len = tga->payload_len;
+    uint32 bpp = tga->bytes_per_pix;
+    size_t have;
+    uint32 n;
+
+    ubyte packet_header;
+
+    while( count > 0 ) {
+
+        if( st->left == 0 ) {
+
+            if( st->pos < len ) {
+                packet_header = src[st->pos++];
+            } else {
+                // well, just let them fill the rest with null pixels then...
+                packet_header = 1;
+            }
+
+            st->left = (packet_header & 0x7F) + 1;
+
+            if( !(packet_header & 0x80) ) {
+                st->kind = TGA_PACKET_RAW;
+            } else if( st->pos + bpp <= len ) {
+                st->kind  = TGA_PACKET_RUN;
+                st->value = st->pos;
+                st->pos  += bpp;
+            } else {
+                st->kind = TGA_PACKET_ZERO;
+                st->pos  = len;
+            }
+
+        }
+
+        n = st->left < count ? st->left : count;
+
+        if( st->kind == TGA_PACKET_RAW ) {
+
+            // a pixel cut short by the end of the file reads as zero, as does everything after it.
+            have = (len - st->pos) / bpp;
+            if( have > n ) {
+                have = n;
+            }
+
+            if( dst != NULL ) {
+                tga_decode_span( dec, src + st->pos, (uint32)have, dst, step );
+                tga_fill_span( dec, dec->zero, n - (uint32)have, dst + (int)have * step, step );
+            }
+
+            st->pos += have * bpp;
+            if( have < n ) {
+                st->pos = len;
+            }
+
+        } else if( dst != NULL ) {
+
+            tga_fill_span( dec, st->kind == TGA_PACKET_RUN ? tga_decode_pixel( dec, src + st->value ) : dec->zero, 
+                n, dst, step );
+
+        }
+
+        if( dst != NULL ) {
+            dst += (int)n * step;
+        }
+
+        st->left -= n;
+        count    -= n;
+
+    }
+
+}
+
+
+
+
 static uint32 tga_convert_color( uint32 pixel, uint32 bpp_in, ubyte alphabits, uint32 format_out ) {
     
     // this is not only responsible for converting from different depths
@@ -1181,18 +2136,3 @@ static int32 ttohl( int32 val ) {
 #endif 
 
 }
-
-
-static int32 htotl( int32 val ) {
-
-#ifdef WORDS_BIGENDIAN
-    return( ((val & 0x000000FF) << 24) +
-            ((val & 0x0000FF00) << 8)  +
-            ((val & 0x00FF0000) >> 8)  +
-            ((val & 0xFF000000) >> 24) );
-#else
-    return( val );
-#endif 
-
-}
-
@@ -1,6 +1,8 @@
 #ifndef _libtarga_h_
 #define _libtarga_h_
 
+#include <stddef.h>     /* size_t */
+
 
 /* uncomment this line if you're compiling on a big-endian machine */
 /* #define WORDS_BIGENDIAN */
@@ -63,8 +65,16 @@
 /*
    Image data will start in the low-left corner
    of the image.
+
+   These are the corners a file itself can start
+   from, as tga_probe reports them.
 */
 
+#define TGA_LOWER_LEFT        (0)
+#define TGA_LOWER_RIGHT       (1)
+#define TGA_UPPER_LEFT        (2)
+#define TGA_UPPER_RIGHT       (3)
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -81,11 +91,76 @@ void * tga_create( int width, int height, unsigned int format );
 void * tga_load( const char * file, int * width, int * height, unsigned int format );
 
 
+/* Probing images  --  reads only the 18 byte header, so the colormap and pixels aren't checked.
+   A return of 1 indicates success, 0 indicates error (info is filled in either way if the 
+   header could be read). */
+typedef struct tga_info {
+    int width;
+    int height;
+    int depth;              /* bits per data unit in the file (index or color) */
+    int true_bits;          /* bits per pixel once any colormap is applied */
+    int alphabits;
+    int image_type;         /* the targa image type code, 1-3 or 9-11 */
+    int rle;                /* 1 if the pixels are run-length encoded */
+    int cmap_length;        /* colormap entries, 0 if there's no colormap */
+    int cmap_entry_size;
+    int origin;             /* one of the corners above */
+} tga_info;
+
+int tga_probe( const char * file, tga_info * info );
+
+
+/* Reading images a band of rows at a time  --  the file is mapped rather than read, and rows
+   are numbered from the top of the image whatever order the file stores them in.
+   tga_open returns NULL on a fatal error, tga_read_rows returns 1 on success and 0 on error. */
+typedef struct tga_reader tga_reader;
+
+tga_reader * tga_open( const char * file, int * width, int * height );
+int tga_read_rows( tga_reader * tga, int row, int count, unsigned char * dat, unsigned int format );
+void tga_close( tga_reader * tga );
+
+/* 1 if the file has no alpha to speak of, so every pixel tga_read_rows hands out is opaque.
+   0 means it may not be, and only looking at the pixels will tell. */
+int tga_opaque( const tga_reader * tga );
+
+
+/* Pixel conversion kernels  --  vectorized where the compiler allows, 'count' is in pixels.
+   tga_swizzle_premultiply:   straight BGRA (file order) to premultiplied RGBA.
+   tga_swizzle_unpremultiply: premultiplied RGBA to straight BGRA, clamped.
+   tga_unpremultiply_rgb:     premultiplied RGBA to RGB over a black background. */
+void tga_swizzle_premultiply( unsigned char * dst, const unsigned char * src, int count );
+void tga_swizzle_unpremultiply( unsigned char * dst, const unsigned char * src, int count );
+void tga_unpremultiply_rgb( unsigned char * rgb, const unsigned char * rgba, int count );
+
+
 /* Writing images to file  --  a return of 1 indicates success, 0 indicates error*/
 int tga_write_raw( const char * file, int width, int height, unsigned char * dat, unsigned int format );
 int tga_write_rle( const char * file, int width, int height, unsigned char * dat, unsigned int format );
 
 
+/* Encoding images to memory  --  the whole file, header and all, just as tga_write_raw (rle = 0)
+   or tga_write_rle (rle = 1) would write it.  Pass a buf of at least tga_encoded_size_max bytes
+   to reuse it, or NULL to have one malloc'd (release it with free).  Returns the buffer with its
+   encoded length in *len, or NULL on error. */
+size_t tga_encoded_size_max( int width, int height, unsigned int format, int rle );
+unsigned char * tga_encode_to_buffer( int width, int height, unsigned char * dat, unsigned int format, 
+                                      int rle, unsigned char * buf, size_t * len );
+
+
+/* Writing images a band of rows at a time  --  rows are numbered from the top, as tga_read_rows
+   hands them out, and can come in any order; the file is laid out just as tga_write_raw's is.
+   tga_begin_write returns NULL on a fatal error, the others return 1 on success and 0 on error.
+   tga_begin_update reopens a file tga_begin_write (or tga_write_raw) made at the same size and
+   format, leaving its rows as they are until they're written over; any other file gives NULL. */
+typedef struct tga_writer tga_writer;
+
+tga_writer * tga_begin_write( const char * file, int width, int height, unsigned int format );
+tga_writer * tga_begin_update( const char * file, int width, int height, unsigned int format );
+int tga_write_rows( tga_writer * tga, int row, int count, unsigned char * dat );
+void tga_write_opaque( tga_writer * tga, int opaque );   /* rows that follow all have alpha 255 */
+int tga_end_write( tga_writer * tga );
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      KernelTests.cpp
+//
+//      Checks the pixel conversion kernels, and the TargaImage methods built
+//  on them, against the scalar code they replaced, bit for bit.  Each output
+//  channel depends only on its own value and the alpha, so every one of the
+//  65536 (value, alpha) pairs in every channel covers all 2^32 RGBA values.
+//  Exits non-zero on any mismatch.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "TargaImage.h"
+
+// after the standard headers -- libtarga.h #defines 'byte'
+#include "libtarga.h"
+
+using namespace std;
+
+// constants
+const int       c_nPairs                = 256 * 256;                    // (value, alpha) pairs a channel can hold
+const int       c_nRotations            = 4;                            // starting lanes each pixel is run in
+
+
+// The old per-pixel premultiply from tga_convert_color: a file's straight BGRA
+// to premultiplied RGBA.
+static void ScalarPremultiply(unsigned char* pDst, const unsigned char* pSrc)
+{
+    unsigned char b = pSrc[0], g = pSrc[1], r = pSrc[2], a = pSrc[3];
+
+    pDst[0] = (unsigned char)(((float)r / 255.0f) * ((float)a / 255.0f) * 255.0f);
+    pDst[1] = (unsigned char)(((float)g / 255.0f) * ((float)a / 255.0f) * 255.0f);
+    pDst[2] = (unsigned char)(((float)b / 255.0f) * ((float)a / 255.0f) * 255.0f);
+    pDst[3] = a;
+}// ScalarPremultiply
+
+
+// The old per-pixel un-premultiply from tga_write_raw and tga_write_rle:
+// premultiplied RGBA to a file's straight BGRA, clamped.
+static void ScalarUnpremultiply(unsigned char* pDst, const unsigned char* pSrc)
+{
+    float red   = pSrc[0] / 255.0f;
+    float green = pSrc[1] / 255.0f;
+    float blue  = pSrc[2] / 255.0f;
+    float alpha = pSrc[3] / 255.0f;
+
+    if (alpha > 0.0001)
+    {
+        red /= alpha;
+        green /= alpha;
+        blue /= alpha;
+    }// if
+
+    red = red > 1.0f ? 255.0f : red * 255.0f;
+    green = green > 1.0f ? 255.0f : green * 255.0f;
+    blue = blue > 1.0f ? 255.0f : blue * 255.0f;
+    alpha = alpha > 1.0f ? 255.0f : alpha * 255.0f;
+
+    pDst[0] = (unsigned char)blue;
+    pDst[1] = (unsigned char)green;
+    pDst[2] = (unsigned char)red;
+    pDst[3] = (unsigned char)alpha;
+}// ScalarUnpremultiply
+
+
+// The old TargaImage::RGBA_To_RGB: premultiplied RGBA to RGB over black.
+static void ScalarRGBA_To_RGB(unsigned char* pRgb, const unsigned char* pRgba)
+{
+    if (pRgba[3] == 0)
+    {
+        pRgb[0] = pRgb[1] = pRgb[2] = 0;
+        return;
+    }// if
+
+    float fScale = (float)255 / (float)pRgba[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        int nValue = (int)floor(pRgba[i] * fScale);
+        pRgb[i] = nValue < 0 ? 0 : (nValue > 255 ? 255 : nValue);
+    }// for
+}// ScalarRGBA_To_RGB
+
+
+// Fills pPixels with c_nPairs pixels holding every (value, alpha) pair in each
+// channel, starting rotation pixels in.  The channels hold different values,
+// so a kernel that mixes them up shows.
+static void FillPairs(unsigned char* pPixels, int nRotation = 0)
+{
+    for (int i = 0; i < c_nPairs; ++i)
+    {
+        int n = (i + nRotation) % c_nPairs;
+        unsigned char nValue = (unsigned char)n;
+
+        pPixels[i * 4] = nValue;
+        pPixels[i * 4 + 1] = (unsigned char)(255 - nValue);
+        pPixels[i * 4 + 2] = (unsigned char)(nValue ^ 0x5A);
+        pPixels[i * 4 + 3] = (unsigned char)(n >> 8);
+    }// for
+}// FillPairs
+
+
+// Runs one libtarga kernel over every pair, starting it in each lane, and
+// counts the pixels that differ from the scalar version.  Each run is split a
+// few pixels from its end, differently each time, so the kernel's scalar tail
+// gets pixels from every part of the run too.
+template <void (*Scalar)(unsigned char*, const unsigned char*)>
+static long long CheckKernel(void (*Kernel)(unsigned char*, const unsigned char*, int), int nOutBytes)
+{
+    vector<unsigned char>   aSrc(c_nPairs * 4), aOut(c_nPairs * nOutBytes), aExpected(nOutBytes);
+    long long               nMismatches = 0;
+
+    for (int r = 0; r < c_nRotations; ++r)
+    {
+        FillPairs(&aSrc[0], r * (c_nPairs / c_nRotations + 1));
+
+        for (int nTail = 1; nTail <= 7; ++nTail)
+        {
+            int nSplit = c_nPairs - nTail;
+            Kernel(&aOut[0], &aSrc[0], nSplit);
+            Kernel(&aOut[nSplit * nOutBytes], &aSrc[nSplit * 4], nTail);
+
+            for (int i = 0; i < c_nPairs; ++i)
+            {
+                Scalar(&aExpected[0], &aSrc[i * 4]);
+                if (memcmp(&aExpected[0], &aOut[i * nOutBytes], nOutBytes))
+                    ++nMismatches;
+            }// for
+        }// for
+    }// for
+
+    return nMismatches;
+}// CheckKernel
+
+
+// To_RGB on an image of every pair, and on one of just the opaque ones, which
+// takes the path that skips dividing by alpha.
+static long long CheckTo_RGB()
+{
+    vector<unsigned char>   aPixels(c_nPairs * 4);
+    long long               nMismatches = 0;
+
+    FillPairs(&aPixels[0]);
+    for (int nOpaque = 0; nOpaque < 2; ++nOpaque)
+    {
+        // the opaque pairs are the last row of 256
+        int nHeight = nOpaque ? 1 : 256;
+        unsigned char* pPixels = &aPixels[nOpaque ? (c_nPairs - 256) * 4 : 0];
+        TargaImage image(256, nHeight, pPixels);
+        unsigned char* pRgb = image.To_RGB();
+
+        for (int i = 0; i < 256 * nHeight; ++i)
+        {
+            unsigned char aExpected[3];
+            ScalarRGBA_To_RGB(aExpected, pPixels + i * 4);
+            if (memcmp(aExpected, pRgb + i * 3, 3))
+                ++nMismatches;
+        }// for
+
+        delete[] pRgb;
+    }// for
+
+    return nMismatches;
+}// CheckTo_RGB
+
+
+// Difference between images of every pair, the second shifted so each pixel
+// meets a different value and alpha, and then between an opaque image and
+// the pairs.
+static long long CheckDifference()
+{
+    vector<unsigned char>   aPixels(c_nPairs * 4), aOther(c_nPairs * 4);
+    long long               nMismatches = 0;
+
+    for (int nOpaque = 0; nOpaque < 2; ++nOpaque)
+    {
+        FillPairs(&aPixels[0]);
+        FillPairs(&aOther[0], c_nPairs / 3);
+        if (nOpaque)
+            for (int i = 0; i < c_nPairs; ++i)
+                aOther[i * 4 + 3] = 255;
+
+        TargaImage image(256, 256, &aPixels[0]);
+        TargaImage other(256, 256, &aOther[0]);
+        if (!image.Difference(&other))
+            return -1;
+
+        for (int i = 0; i < c_nPairs; ++i)
+        {
+            unsigned char aRgb1[3], aRgb2[3], aExpected[4];
+            ScalarRGBA_To_RGB(aRgb1, &aPixels[i * 4]);
+            ScalarRGBA_To_RGB(aRgb2, &aOther[i * 4]);
+            for (int c = 0; c < 3; ++c)
+                aExpected[c] = (unsigned char)abs(aRgb1[c] - aRgb2[c]);
+            aExpected[3] = 255;
+
+            if (memcmp(aExpected, image.data + (size_t)i * 4, 4))
+                ++nMismatches;
+        }// for
+    }// for
+
+    return nMismatches;
+}// CheckDifference
+
+
+// Prints how a check went and returns whether it passed.
+static bool Report(const char* sName, long long nMismatches)
+{
+    if (nMismatches < 0)
+        printf("%-28s FAILED to run\n", sName);
+    else
+        printf("%-28s %s, %lld mismatched pixels\n", sName, nMismatches ? "FAILED" : "ok", nMismatches);
+    fflush(stdout);
+    return nMismatches == 0;
+}// Report
+
+
+int main()
+{
+    bool bPassed = true;
+
+    bPassed = Report("tga_swizzle_premultiply", CheckKernel<ScalarPremultiply>(tga_swizzle_premultiply, 4)) && bPassed;
+    bPassed = Report("tga_swizzle_unpremultiply", CheckKernel<ScalarUnpremultiply>(tga_swizzle_unpremultiply, 4)) && bPassed;
+    bPassed = Report("tga_unpremultiply_rgb", CheckKernel<ScalarRGBA_To_RGB>(tga_unpremultiply_rgb, 3)) && bPassed;
+    bPassed = Report("TargaImage::To_RGB", CheckTo_RGB()) && bPassed;
+    bPassed = Report("TargaImage::Difference", CheckDifference()) && bPassed;
+
+    return bPassed ? 0 : 1;
+}// main